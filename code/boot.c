@@ -0,0 +1,21 @@
+#include <stdint.h>
+#include "boot.h"
+
+/* at most 8 steps, which is plenty */
+void boot_run(const __flash struct boot_step *steps, uint8_t n) {
+	uint8_t all = (1 << n) - 1;
+	uint8_t started = 0, done = 0;
+
+	while (done != all) {
+		for (uint8_t i = 0; i < n; i++) {
+			uint8_t bit = 1 << i;
+			if (!(started & bit) && !(steps[i].deps & ~done)) {
+				steps[i].start();
+				started |= bit;
+			}
+			if ((started & bit) && !(done & bit) && (!steps[i].done || steps[i].done())) {
+				done |= bit;
+			}
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+
+/* one step of the boot. it is started as soon as all steps in deps are
+ * done, and is done once done() says so (right away without one). the
+ * steps that only wait for something overlap that way.
+ */
+struct boot_step {
+	uint8_t deps; /* bit n: step n */
+	void (*start)();
+	uint8_t (*done)();
+};
+
+void boot_run(const __flash struct boot_step *steps, uint8_t n);
+
+#endif
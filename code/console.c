@@ -6,55 +6,128 @@
 
 #include "console.h"
 #include "debug.h"
+#include "trace.h"
+#include "uart.h"
 
 #ifdef LCD_SUPPORT
 
 #define LINES 4
 #define COLS 20
+/* textmem is what should be on the display, lcdmem what is (or has been
+ * queued for it). the LCD timer compares the dirty lines and only sends
+ * the cells that differ.
+ */
 static uint8_t textmem[LINES*COLS];
-static uint8_t cur_x, cur_y;
+static uint8_t lcdmem[LINES*COLS];
+static volatile uint8_t dirty[LINES];
+static volatile uint8_t cur_x, cur_y;
 static uint8_t debug_initialized = 0;
 
 static uint8_t delayed_newline = 0;
 
-static void refresh_screen() {
-	for (int y = 0; y < LINES; y++) {
-		lcd_setcursor(0, y);
-		for (int x = 0; x < COLS; x++) {
-			debug_char(textmem[y*COLS + x]);
+/* refresh state, only used from the LCD timer */
+static uint8_t scan_x, scan_y = LINES;
+static uint8_t lcd_pos = 0xff; /* textmem index of the LCD cursor, 0xff if unknown */
+
+static void mark_dirty(uint8_t y) {
+	/* textmem has to be written before the timer sees the flag */
+	__asm__ __volatile__ ("" ::: "memory");
+	dirty[y] = 1;
+}
+
+static void mark_all_dirty() {
+	for (uint8_t y = 0; y < LINES; y++) {
+		mark_dirty(y);
+	}
+}
+
+/* called by the LCD timer whenever its queue has run empty.
+ * queues at most one command and returns 0 if the display is up to date.
+ */
+uint8_t lcd_idle() {
+	while (1) {
+		if (scan_y >= LINES) {
+			uint8_t y = 0;
+			while (y < LINES && !dirty[y]) {
+				y++;
+			}
+
+			if (y == LINES) {
+				/* all done, show the cursor where the next
+				 * character will go
+				 */
+				uint8_t want = cur_y*COLS + cur_x;
+				if (lcd_pos != want) {
+					lcd_setcursor(cur_x, cur_y);
+					lcd_pos = want;
+					return 1;
+				}
+				return 0;
+			}
+
+			dirty[y] = 0;
+			scan_y = y;
+			scan_x = 0;
+		}
+
+		for (; scan_x < COLS; scan_x++) {
+			uint8_t i = scan_y*COLS + scan_x;
+			uint8_t c = textmem[i];
+			if (lcdmem[i] == c) {
+				continue;
+			}
+
+			if (lcd_pos != i) {
+				lcd_setcursor(scan_x, scan_y);
+				lcd_pos = i;
+				return 1;
+			}
+
+			debug_char(c);
+			lcdmem[i] = c;
+			/* the address counter does not wrap to the next line
+			 * in display order
+			 */
+			lcd_pos = (scan_x == COLS - 1) ? 0xff : i + 1;
+			scan_x++;
+			return 1;
 		}
+
+		scan_y = LINES;
 	}
-	lcd_setcursor(cur_x, cur_y);
 }
 
 static void scroll() {
 	memmove(textmem, textmem + COLS, (LINES-1) * COLS);
 	memset(textmem + (LINES-1) * COLS, ' ', COLS);
+	mark_all_dirty();
 }
 
-void console_reset() {
+static void screen_reset() {
 	if (!debug_initialized) {
 		debug_init();
 		debug_initialized++;
+		/* unknown contents, force everything to be redrawn */
+		memset(lcdmem, 0, LINES*COLS);
 	}
 	memset(textmem, ' ', LINES*COLS);
 	cur_x = 0;
 	cur_y = 0;
 	delayed_newline = 0;
-	refresh_screen();
+	mark_all_dirty();
+	lcd_kick();
 }
 
-void console_char(uint8_t data) {
+static void screen_char(uint8_t data) {
 	if (delayed_newline && data != '\n') {
 		scroll();
 		cur_x = 0;
-		refresh_screen();
 		delayed_newline = 0;
 	}
 
 	if (data != '\n') {
-		debug_char(data);
 		textmem[cur_y*COLS + cur_x] = data;
+		mark_dirty(cur_y);
 		cur_x++;
 	} else {
 		cur_x = COLS;
@@ -67,8 +140,47 @@ void console_char(uint8_t data) {
 			cur_y--;
 			delayed_newline = 1;
 		}
-		lcd_setcursor(cur_x, cur_y);
 	}
+
+	lcd_kick();
+}
+
+#endif
+
+#ifdef CONSOLE_SUPPORT
+
+void console_reset() {
+#ifdef LCD_SUPPORT
+	screen_reset();
+#endif
+#ifdef UART_SUPPORT
+	static uint8_t uart_initialized = 0;
+	if (!uart_initialized) {
+		uart_init();
+		uart_initialized++;
+	}
+	uart_putc('\n');
+#endif
+}
+
+/* block until everything written so far has been shown */
+void console_flush() {
+#ifdef LCD_SUPPORT
+	lcd_flush();
+#endif
+#ifdef UART_SUPPORT
+	uart_flush();
+#endif
+}
+
+void console_char(uint8_t data) {
+#ifdef LCD_SUPPORT
+	screen_char(data);
+#endif
+#ifdef UART_SUPPORT
+	/* keep the line free for trace frames */
+	uart_putc(data == TRACE_SYNC ? '?' : data);
+#endif
 }
 
 void console_str(const char *wat) {
@@ -128,8 +240,10 @@ void console_dec16(uint16_t wat) {
 #else
 
 void console_reset() { }
+void console_flush() { }
 void console_char(uint8_t wat) { }
 void console_str(const char *wat) { }
+void _console_fstr(const __flash char *wat) { }
 void console_hex8(uint8_t wat) { }
 void console_hex16(uint16_t wat) { }
 void console_hex32(uint32_t wat) { }
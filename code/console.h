@@ -4,17 +4,22 @@
 #include <avr/pgmspace.h>
 
 void console_reset();
+void console_flush();
 void console_char(uint8_t);
 void console_str(const char *);
 void console_hex8(uint8_t);
 void console_hex16(uint16_t);
 void console_hex32(uint32_t);
 void console_dec16(uint16_t);
+void _console_fstr(const __flash char *);
+
+#if defined(LCD_SUPPORT) || defined(UART_SUPPORT)
+#define CONSOLE_SUPPORT
+#endif
 
-#ifdef LCD_SUPPORT
+#ifdef CONSOLE_SUPPORT
 
 #define console_fstr(x) _console_fstr(PSTR(x))
-void _console_fstr(const __flash char *);
 
 #define console_die(x) do { console_fstr(x); while (1) { }; } while (0)
 
@@ -72,7 +72,7 @@
 
 enum LCD_RS { LCD_COMMAND = 0, LCD_DATA = 1 };
 
-static void shiftreg_set(uint16_t sreg) {
+static void shiftreg_bitbang(uint16_t sreg) {
 	for (signed int i = 15; i >= 0; i--) {
 		if ((sreg >> i) & 1) {
 			PORTB |= (1 << DBG_DATA);
@@ -83,11 +83,62 @@ static void shiftreg_set(uint16_t sreg) {
 		PORTB |= (1 << DBG_SHIFT);
 		PORTB &= ~(1 << DBG_SHIFT);
 	}
+}
+
+#ifdef DEBUG_SPI
+
+/* the 6ISP debug port sits on the SPI pins: SHIFT is SCK, DATA is MOSI.
+ * SYNC is MISO, which the SPI forces to be an input while it is enabled,
+ * so the SPI is switched off for the latch pulse.
+ * SS is REQ# of the bus. whenever a card pulls it low, the SPI drops out
+ * of master mode (mode fault) and the word is lost, so it is shifted out
+ * by hand then. that happens a lot with a bus mastering card.
+ * at clk/2 a byte takes 16 CPU cycles, which is less than entering an
+ * interrupt would, so we just wait for it.
+ */
+static void shiftreg_init() {
+	SPSR = (1 << SPI2X);
+}
+
+static void shiftreg_set(uint16_t sreg) {
+	/* mode 0, MSB first, clk/2 */
+	SPCR = (1 << SPE) | (1 << MSTR);
+	/* a mode fault also sets SPIF, so the waits end either way. after
+	 * one, nothing may be written to SPDR anymore: that clears SPIF and
+	 * as a slave, the transfer would never end.
+	 */
+	if (SPCR & (1 << MSTR)) {
+		SPDR = sreg >> 8;
+		while (!(SPSR & (1 << SPIF))) { }
+	}
+	if (SPCR & (1 << MSTR)) {
+		SPDR = sreg & 0xff;
+		while (!(SPSR & (1 << SPIF))) { }
+	}
+	uint8_t fault = !(SPCR & (1 << MSTR));
+	SPCR = 0;
+	if (fault) {
+		shiftreg_bitbang(sreg);
+	}
 
 	PORTB |= (1 << DBG_SYNC);
 	PORTB &= ~(1 << DBG_SYNC);
 }
 
+#else
+
+static void shiftreg_init() {
+}
+
+static void shiftreg_set(uint16_t sreg) {
+	shiftreg_bitbang(sreg);
+
+	PORTB |= (1 << DBG_SYNC);
+	PORTB &= ~(1 << DBG_SYNC);
+}
+
+#endif
+
 static void write_byte(enum LCD_RS rs, uint8_t d) {
 	uint16_t sreg = d;
 	sreg <<= 8;
@@ -97,24 +148,135 @@ static void write_byte(enum LCD_RS rs, uint8_t d) {
 	shiftreg_set(sreg);
 }
 
+/* output to the LCD is queued and written out by timer 0, one command per
+ * tick, so that nobody has to busy-wait for the controller.
+ * a queue entry is the byte to write, RS in bit 8 and the number of extra
+ * ticks to wait after the command in bits 9-15.
+ */
+#define LCD_TICK_US 48
+#define LCD_QUEUE_SIZE 64 /* power of 2 */
+#define LCD_Q_DATA (1 << 8)
+#define LCD_Q_WAIT(ticks) ((uint16_t)(ticks) << 9)
+#define LCD_CLEAR_TICKS (2000 / LCD_TICK_US)
+#define LCD_TICKS(ms) ((ms) * 1000UL / LCD_TICK_US + 1)
+
+static uint16_t lcd_queue[LCD_QUEUE_SIZE];
+static volatile uint8_t lcd_head = 0, lcd_tail = 0;
+static volatile uint16_t lcd_wait = 0;
+static uint8_t lcd_async = 0;
+static uint16_t lcd_dropped = 0;
+
+static uint8_t lcd_queue_empty() {
+	return lcd_head == lcd_tail;
+}
+
+static uint8_t lcd_queue_full() {
+	return ((lcd_head + 1) & (LCD_QUEUE_SIZE - 1)) == lcd_tail;
+}
+
+/* one timer tick. returns 0 when there is nothing left to do */
+static uint8_t lcd_tick() {
+	if (lcd_wait) {
+		lcd_wait--;
+		return 1;
+	}
+	if (lcd_queue_empty() && !lcd_idle()) {
+		return 0;
+	}
+
+	uint16_t e = lcd_queue[lcd_tail];
+	write_byte((e & LCD_Q_DATA) ? LCD_DATA : LCD_COMMAND, e & 0xff);
+	lcd_wait = e >> 9;
+	lcd_tail = (lcd_tail + 1) & (LCD_QUEUE_SIZE - 1);
+	return 1;
+}
+
+ISR(TIMER0_COMPA_vect) {
+	if (!lcd_tick()) {
+		/* idle, stop ticking until there is something to do */
+		TIMSK0 &= ~(1 << OCIE0A);
+	}
+}
+
+static uint8_t interrupts_enabled() {
+	return SREG & (1 << SREG_I);
+}
+
+/* with interrupts disabled (panic, other ISRs), nobody else is going to
+ * drain the queue, so do it here.
+ */
+static void lcd_drain_sync() {
+	while (lcd_tick()) {
+		_delay_us(LCD_TICK_US);
+	}
+}
+
+/* the check for a free slot and taking it have to happen in one go, an
+ * ISR printing in between could take the last one otherwise
+ */
+static void lcd_put(uint16_t e) {
+	uint8_t queued = 0;
+	for (;;) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (!lcd_queue_full()) {
+				lcd_queue[lcd_head] = e;
+				lcd_head = (lcd_head + 1) & (LCD_QUEUE_SIZE - 1);
+				queued = 1;
+			}
+		}
+		if (queued) {
+			break;
+		}
+#ifdef LCD_DROP_ON_OVERFLOW
+		lcd_dropped++;
+		return;
+#else
+		if (!interrupts_enabled()) {
+			lcd_tick();
+			_delay_us(LCD_TICK_US);
+		}
+#endif
+	}
+	lcd_kick();
+}
+
+/* make sure the timer runs, there might be something to do */
+void lcd_kick() {
+	if (!lcd_async) {
+		return;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (!(TIMSK0 & (1 << OCIE0A))) {
+			TCNT0 = 0;
+			TIFR0 = (1 << OCF0A);
+			TIMSK0 |= (1 << OCIE0A);
+		}
+	}
+}
+
+/* wait until everything has been written to the display */
+void lcd_flush() {
+	if (!interrupts_enabled()) {
+		lcd_drain_sync();
+	} else {
+		while (TIMSK0 & (1 << OCIE0A)) { }
+	}
+}
+
 static void lcd_data(uint8_t data) {
-	write_byte(LCD_DATA, data);
-	_delay_us(46);
+	lcd_put(LCD_Q_DATA | data);
 }
 
 static void lcd_command(uint8_t data) {
-	write_byte(LCD_COMMAND, data);
-	_delay_us(42);
+	lcd_put(data);
 }
 
 void lcd_clear() {
-	lcd_command(LCD_CLEAR_DISPLAY);
-	_delay_ms(2);
+	lcd_put(LCD_CLEAR_DISPLAY | LCD_Q_WAIT(LCD_CLEAR_TICKS));
 }
 
 void lcd_home() {
-	lcd_command(LCD_CURSOR_HOME);
-	_delay_ms(2);
+	lcd_put(LCD_CURSOR_HOME | LCD_Q_WAIT(LCD_CLEAR_TICKS));
 }
 
 void lcd_setcursor(uint8_t x, uint8_t y) {
@@ -138,21 +300,27 @@ void lcd_generatechar(uint8_t code, const uint8_t *data) {
 void debug_init() {
 	DDRB |= (1 << DBG_DATA) | (1 << DBG_SHIFT) | (1 << DBG_SYNC);
 	PORTB &= ~( (1 << DBG_DATA) | (1 << DBG_SHIFT) | (1 << DBG_SYNC) );
+	shiftreg_init();
+
+	/* the queue is drained by timer 0, the init sequence included, so
+	 * nobody waits for the display. output before it is done just queues
+	 * up behind it.
+	 * CTC, clk/64, one tick every 12 timer clocks = 48us
+	 */
+	TCCR0A = (1 << WGM01);
+	TCCR0B = (1 << CS01) | (1 << CS00);
+	OCR0A = LCD_TICK_US * (F_CPU / 1000000UL) / 64 - 1;
+	lcd_async = 1;
 
 	/* wait for display to be ready after bootup */
-	_delay_ms(15);
+	lcd_wait = LCD_TICKS(15);
 
 	/* do a softreset
 	 * setting it to 8bit mode three times allows a reset from any state.
 	 */
-	lcd_command(LCD_SET_FUNCTION | LCD_FUNCTION_8BIT);
-	_delay_ms(5);
-
-	lcd_command(LCD_SET_FUNCTION | LCD_FUNCTION_8BIT);
-	_delay_ms(1);
-
-	lcd_command(LCD_SET_FUNCTION | LCD_FUNCTION_8BIT);
-	_delay_ms(1);
+	lcd_put(LCD_SET_FUNCTION | LCD_FUNCTION_8BIT | LCD_Q_WAIT(LCD_TICKS(5)));
+	lcd_put(LCD_SET_FUNCTION | LCD_FUNCTION_8BIT | LCD_Q_WAIT(LCD_TICKS(1)));
+	lcd_put(LCD_SET_FUNCTION | LCD_FUNCTION_8BIT | LCD_Q_WAIT(LCD_TICKS(1)));
 
 	/* now configure */
 	lcd_command(LCD_SET_FUNCTION | LCD_FUNCTION_8BIT | LCD_FUNCTION_2LINE | LCD_FUNCTION_5X7);
@@ -245,5 +413,11 @@ void debug_hex16(uint16_t wat) {
 void debug_dec16(uint16_t wat) {
 }
 
+void lcd_flush() {
+}
+
+void lcd_kick() {
+}
+
 
 #endif
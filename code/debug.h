@@ -12,6 +12,12 @@ void debug_hex8(uint8_t);
 void debug_hex16(uint16_t);
 void debug_dec16(uint16_t);
 
+void lcd_flush();
+void lcd_kick();
+/* provided by the user of the display: called from the LCD timer when the
+ * queue is empty, may queue one more command and returns nonzero if it did
+ */
+uint8_t lcd_idle();
 void lcd_clear();
 void lcd_home();
 void lcd_setcursor(uint8_t x, uint8_t y);
@@ -0,0 +1,86 @@
+#include <stdint.h>
+
+#include "console.h"
+#include "diag.h"
+#include "exerciser.h"
+#include "rom.h"
+#include "vpd.h"
+
+#include "pci/arbiter.h"
+#include "pci/device.h"
+#include "pci/hist.h"
+#include "pci/monitor.h"
+#include "pci/pci.h"
+#include "pci/registers.h"
+#include "pci/stats.h"
+#include "pci/wave.h"
+
+/* addresses the diagnostic modes map things at */
+#define DIAG_BAR_BASE 0xdd000000
+#define DIAG_ROM_BASE 0xe0000000 /* aligned for ROMs up to 512M */
+
+#define DIAG_EXERCISER_OPS 10000
+#define DIAG_MONITOR_CLOCKS 100000
+
+#ifdef DIAG_EXERCISER
+static void diag_mode(struct pci_dev *dev) {
+	struct exerciser_report r;
+
+	pci_bar_assign64(dev, DIAG_BAR, DIAG_BAR_BASE);
+	pci_config_write16(PCIR_COMMAND, PCIM_CMD_PORTEN | PCIM_CMD_MEMEN);
+	if (!exerciser_run(dev, DIAG_BAR, 0, EXERCISER_MAX_DWORDS, DIAG_EXERCISER_OPS, 1, &r)) {
+		console_fstr("BAR too small\n");
+		return;
+	}
+	exerciser_dump(&r);
+}
+#endif
+
+#ifdef DIAG_ROM
+static void diag_mode(struct pci_dev *dev) {
+	rom_dump(dev, DIAG_ROM_BASE);
+}
+#endif
+
+#ifdef DIAG_VPD
+static void diag_mode(struct pci_dev *dev) {
+	struct vpd v;
+	if (!vpd_read(dev, &v)) {
+		console_fstr("no VPD\n");
+		return;
+	}
+	vpd_dump(&v);
+}
+#endif
+
+#ifdef DIAG_MONITOR
+static void diag_mode(struct pci_dev *dev) {
+	/* whatever the card does on its own, it needs to be a master for it */
+	pci_config_write16(PCIR_COMMAND, pci_config_read16(PCIR_COMMAND) | PCIM_CMD_BUSMASTEREN);
+	monitor_capture(DIAG_MONITOR_CLOCKS, 1);
+	monitor_dump();
+}
+#endif
+
+/* on function 0, then everything the build counts */
+void diag_run() {
+#ifdef DIAG_SUPPORT
+	struct pci_dev *dev = &pci_devs[0];
+	pci_select(dev);
+	diag_mode(dev);
+
+	console_fstr("\n");
+	arbiter_dump();
+#ifdef PCI_STATS
+	console_fstr("\n");
+	pci_stats_dump();
+#endif
+#ifdef PCI_HIST
+	pci_hist_dump();
+#endif
+#ifdef PCI_WAVE
+	wave_dump();
+#endif
+	console_fstr("\n");
+#endif
+}
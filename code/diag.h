@@ -0,0 +1,21 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+/* diagnostic modes, one of them is picked at build time and runs instead
+ * of the drivers:
+ * -DDIAG_EXERCISER exerciser on BAR DIAG_BAR (has to be buffer RAM!)
+ * -DDIAG_ROM       stream out the expansion ROM
+ * -DDIAG_VPD       read and list the Vital Product Data
+ * -DDIAG_MONITOR   watch the bus with GNT# given to the card
+ */
+#if defined(DIAG_EXERCISER) || defined(DIAG_ROM) || defined(DIAG_VPD) || defined(DIAG_MONITOR)
+#define DIAG_SUPPORT
+#endif
+
+#ifndef DIAG_BAR
+#define DIAG_BAR 0
+#endif
+
+void diag_run();
+
+#endif
@@ -0,0 +1,55 @@
+#include <stdint.h>
+
+#include "console.h"
+#include "drivers.h"
+#include "lspci.h"
+#include "rtl8139.h"
+#include "rtl8169.h"
+
+#include "pci/device.h"
+
+static const __flash struct pci_id pci_ids[] = {
+	{ 0x816910ec, PCI_ANY_ID, 0, 0, PCI_ID_SUBSYS, "RTL8169/8110 GBE    ", &rtl8169_driver },
+	{ 0x813910ec, PCI_ANY_ID, 0, 0, PCI_ID_SUBSYS, "RTL8139/8100/1L 100M", &rtl8139_driver },
+	{ 0x00351033, 0x010514c2, 0, 0, 0,             "USB2.0 Host PTI-205N", 0 },
+	/* no sub ID, values appear useless (eeeb:dbaf here) */
+	{ 0x000210b6, PCI_ANY_ID, 0, 0, 0,             "Madge 16/4 Ringnode\n", 0 },
+	{ 0x30381106, PCI_ANY_ID, 0, 0, PCI_ID_SUBSYS, "USB1.1 Host VIA VT82", 0 },
+	{ 0x12161113, 0x12161113, 0, 0, 0,             "Accton EN1207F\n", 0 },
+	{ 0x20311904, PCI_ANY_ID, 0, 0, PCI_ID_SUBSYS, "Silan SC92031\n", 0 },
+	{ 0x30441106, PCI_ANY_ID, 0, 0, PCI_ID_SUBSYS, "Firewire VIA VT63xx ", 0 },
+};
+
+static uint8_t id_matches(const __flash struct pci_id *id, const struct pci_dev *dev) {
+	return id->devvendor == dev->devvendor
+		&& (id->subvendor == PCI_ANY_ID || id->subvendor == dev->subvendor)
+		&& ((dev->class ^ id->class) & id->class_mask) == 0;
+}
+
+const __flash struct pci_id *pci_id_lookup(const struct pci_dev *dev) {
+	for (uint8_t i = 0; i < sizeof(pci_ids)/sizeof(pci_ids[0]); i++) {
+		if (id_matches(&pci_ids[i], dev)) {
+			return &pci_ids[i];
+		}
+	}
+	return 0;
+}
+
+/* give every enumerated function to its driver, or at least list it.
+ * note that attach usually does not return.
+ */
+void drivers_attach() {
+	for (uint8_t i = 0; i < pci_ndevs; i++) {
+		struct pci_dev *dev = &pci_devs[i];
+		const __flash struct pci_id *id = pci_id_lookup(dev);
+
+		if (i) { console_fstr("\n"); }
+
+		pci_select(dev);
+		if (id && id->driver && !id->driver->probe(dev)) {
+			id->driver->attach(dev);
+		} else {
+			lspci(dev);
+		}
+	}
+}
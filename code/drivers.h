@@ -0,0 +1,33 @@
+#ifndef DRIVERS_H
+#define DRIVERS_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "pci/device.h"
+
+struct pci_driver {
+	/* decide if the function can be driven. 0 = yes */
+	uint8_t (*probe)(struct pci_dev *);
+	void (*attach)(struct pci_dev *);
+};
+
+#define PCI_ANY_ID 0xffffffff
+
+/* print subsystem IDs in front of the name */
+#define PCI_ID_SUBSYS (1 << 0)
+
+/* one line of the match table. the first matching line wins. */
+struct pci_id {
+	uint32_t devvendor;
+	uint32_t subvendor;  /* or PCI_ANY_ID */
+	uint32_t class;      /* compared under class_mask */
+	uint32_t class_mask;
+	uint8_t flags;
+	char name[21];       /* one LCD line */
+	const __flash struct pci_driver *driver;
+};
+
+const __flash struct pci_id *pci_id_lookup(const struct pci_dev *dev);
+void drivers_attach();
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "console.h"
+#include "events.h"
+#include "timing.h"
+#include "pci/pins.h"
+
+/* single producer (interrupt context), single consumer (main loop) queue.
+ * the producer only writes ev_head, the consumer only ev_tail, and both
+ * are a single byte, so neither side needs to disable interrupts.
+ * several handlers do not interrupt each other, so they count as one
+ * producer.
+ */
+
+#define EVENT_QUEUE_SIZE 16 /* power of 2 */
+
+static struct event queue[EVENT_QUEUE_SIZE];
+static volatile uint8_t ev_head = 0, ev_tail = 0;
+static struct event_counts counts;
+
+/* interrupt context only */
+void event_push(uint8_t kind, uint8_t data) {
+	uint8_t next = (ev_head + 1) & (EVENT_QUEUE_SIZE - 1);
+	if (next == ev_tail) {
+		counts.dropped++;
+		return;
+	}
+	queue[ev_head].time = timing_now();
+	queue[ev_head].kind = kind;
+	queue[ev_head].data = data;
+	ev_head = next;
+}
+
+void event_count_err(uint8_t pink) {
+	if (!(pink & PK_PERR)) {
+		counts.perr++;
+	}
+	if (!(pink & PK_SERR)) {
+		counts.serr++;
+	}
+}
+
+/* main loop only, returns 0 if there was nothing */
+uint8_t event_pop(struct event *e) {
+	uint8_t tail = ev_tail;
+	if (tail == ev_head) {
+		return 0;
+	}
+	*e = queue[tail];
+	ev_tail = (tail + 1) & (EVENT_QUEUE_SIZE - 1);
+	return 1;
+}
+
+void events_counts_get(struct event_counts *c) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy(c, &counts, sizeof(*c));
+	}
+}
+
+/* print whatever happened since the last call */
+void events_drain() {
+	struct event e;
+	while (event_pop(&e)) {
+		switch (e.kind) {
+		case EVENT_ERR:
+			console_fstr("*ERR");
+			if (!(e.data & PK_PERR)) {
+				console_fstr(" P");
+			}
+			if (!(e.data & PK_SERR)) {
+				console_fstr(" S");
+			}
+			break;
+		}
+		console_fstr(" @");
+		console_hex32(e.time);
+		console_fstr("\n");
+	}
+
+	static uint16_t dropped_seen = 0;
+	uint16_t dropped;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		dropped = counts.dropped;
+	}
+	if (dropped != dropped_seen) {
+		console_fstr("*lost ");
+		console_hex16(dropped - dropped_seen);
+		console_fstr("\n");
+		dropped_seen = dropped;
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+
+/* things interrupt handlers noticed, for the main loop to report.
+ * handlers only timestamp and count, printing happens in events_drain().
+ */
+
+enum event_kind {
+	EVENT_ERR, /* PERR#/SERR# asserted, data is PINK */
+};
+
+struct event {
+	uint32_t time; /* timing_now() */
+	uint8_t kind;
+	uint8_t data;
+};
+
+struct event_counts {
+	uint16_t perr;
+	uint16_t serr;
+	uint16_t dropped; /* queue was full */
+};
+
+void event_push(uint8_t kind, uint8_t data);
+void event_count_err(uint8_t pink);
+uint8_t event_pop(struct event *e);
+void events_counts_get(struct event_counts *c);
+void events_drain();
+
+#endif
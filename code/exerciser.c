@@ -0,0 +1,272 @@
+#include <stdint.h>
+#include <string.h>
+#include "pci/pci.h"
+#include "pci/registers.h"
+#include "pci/stats.h"
+
+#include "exerciser.h"
+
+#include "console.h"
+#include "timing.h"
+
+/* bus exerciser.
+ * random reads and writes of all sizes and byte lanes, plus bursts for
+ * memory BARs, against a window of a BAR that behaves like plain memory
+ * (a buffer RAM, not a register file!). everything read is checked
+ * against a shadow of what has been written.
+ * the BAR has to be assigned and decoding enabled already.
+ */
+
+static uint32_t shadow[EXERCISER_MAX_DWORDS];
+static uint32_t rnd_state;
+
+/* xorshift32, good enough to pick operations and data */
+static uint32_t rnd() {
+	uint32_t x = rnd_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return rnd_state = x;
+}
+
+#define MAX_BURST 8
+
+static uint8_t is_io;
+static uint32_t base;
+static struct exerciser_report *rep;
+
+static void mismatch(uint16_t idx, uint32_t expected, uint32_t got) {
+	/* only the first few, the rest is just counted */
+	if (rep->mismatches++ < 4) {
+		console_fstr("\n!");
+		console_hex32(base + 4 * idx);
+		console_fstr(" ");
+		console_hex32(expected);
+		console_fstr("/");
+		console_hex32(got);
+	}
+}
+
+static void latency(uint8_t kind, uint16_t cycles) {
+	struct exerciser_latency *l = &rep->latency[kind];
+	if (cycles < l->min) {
+		l->min = cycles;
+	}
+	if (cycles > l->max) {
+		l->max = cycles;
+	}
+	l->count++;
+	l->sum += cycles;
+}
+
+static void op_read(uint32_t r, uint16_t idx) {
+	uint32_t addr = base + 4 * idx;
+	uint8_t lane = (r >> 5) & 0b11;
+	uint32_t got, expected;
+
+	uint16_t t = timing_now16();
+	switch ((r >> 3) & 0b11) {
+	case 0:
+		got = is_io ? pci_io_read8(addr + lane) : pci_mem_read8(addr + lane);
+		expected = (shadow[idx] >> (8 * lane)) & 0xff;
+		break;
+	case 1:
+		lane &= 0b10;
+		got = is_io ? pci_io_read16(addr + lane) : pci_mem_read16(addr + lane);
+		expected = (shadow[idx] >> (8 * lane)) & 0xffff;
+		break;
+	default:
+		got = is_io ? pci_io_read32(addr) : pci_mem_read32(addr);
+		expected = shadow[idx];
+		break;
+	}
+	latency(EXERCISER_LATENCY_READ, timing_elapsed16(t));
+
+	if (got != expected) {
+		mismatch(idx, expected, got);
+	}
+	rep->transactions++;
+	rep->dwords++;
+}
+
+static void op_write(uint32_t r, uint16_t idx) {
+	uint32_t addr = base + 4 * idx;
+	uint8_t lane = (r >> 5) & 0b11;
+	uint32_t val = rnd();
+	uint32_t mask;
+
+	uint16_t t = timing_now16();
+	switch ((r >> 3) & 0b11) {
+	case 0:
+		if (is_io) {
+			pci_io_write8(addr + lane, val);
+		} else {
+			pci_mem_write8(addr + lane, val);
+		}
+		mask = 0xffUL << (8 * lane);
+		break;
+	case 1:
+		lane &= 0b10;
+		if (is_io) {
+			pci_io_write16(addr + lane, val);
+		} else {
+			pci_mem_write16(addr + lane, val);
+		}
+		mask = 0xffffUL << (8 * lane);
+		break;
+	default:
+		lane = 0;
+		if (is_io) {
+			pci_io_write32(addr, val);
+		} else {
+			pci_mem_write32(addr, val);
+		}
+		mask = 0xffffffff;
+		break;
+	}
+	latency(EXERCISER_LATENCY_WRITE, timing_elapsed16(t));
+
+	shadow[idx] = (shadow[idx] & ~mask) | ((val << (8 * lane)) & mask);
+	rep->transactions++;
+	rep->dwords++;
+}
+
+static void op_burst(uint32_t r, uint16_t idx, uint16_t dwords) {
+	uint32_t buf[MAX_BURST];
+	uint8_t n = 1 + ((r >> 24) % MAX_BURST);
+	if (n > dwords - idx) {
+		n = dwords - idx;
+	}
+	uint8_t write = r & 1;
+
+	if (write) {
+		for (uint8_t i = 0; i < n; i++) {
+			buf[i] = rnd();
+		}
+	}
+
+	uint16_t t = timing_now16();
+	uint16_t done = write
+		? pci_mem_write_burst(base + 4 * idx, buf, n)
+		: pci_mem_read_burst(base + 4 * idx, buf, n);
+	latency(EXERCISER_LATENCY_BURST, timing_elapsed16(t));
+
+	if (done < n) {
+		rep->short_bursts++;
+	}
+	for (uint8_t i = 0; i < done; i++) {
+		if (write) {
+			shadow[idx + i] = buf[i];
+		} else if (buf[i] != shadow[idx + i]) {
+			mismatch(idx + i, shadow[idx + i], buf[i]);
+		}
+	}
+	rep->transactions++;
+	rep->dwords += done;
+}
+
+/* offset in bytes into the BAR, must be dword aligned. a 64 bit BAR has
+ * to be assigned below 4G.
+ * returns 0 if the window does not fit, otherwise fills in the report.
+ */
+uint8_t exerciser_run(const struct pci_dev *dev, uint8_t bar, uint16_t offset, uint16_t dwords, uint32_t ops, uint32_t seed, struct exerciser_report *r) {
+	uint64_t size = pci_bar_size(dev, bar);
+	if (!size || dwords == 0 || dwords > EXERCISER_MAX_DWORDS || (offset & 0b11)) {
+		return 0;
+	}
+	if (pci_bar_is64(dev, bar) && dev->bar_base[bar + 1]) {
+		return 0;
+	}
+	if ((uint32_t)offset + 4 * dwords > size) {
+		return 0;
+	}
+	is_io = PCI_BAR_IO(dev->bar_size[bar]);
+	uint32_t mask = is_io ? PCIM_BAR_IO_BASE : (uint32_t)PCIM_BAR_MEM_BASE;
+	base = (dev->bar_base[bar] & mask) + offset;
+
+	memset(r, 0, sizeof(*r));
+	for (uint8_t k = 0; k < 3; k++) {
+		r->latency[k].min = 0xffff;
+	}
+	rep = r;
+	rnd_state = seed ? seed : 1;
+
+	/* known contents to start with */
+	for (uint16_t i = 0; i < dwords; i++) {
+		shadow[i] = rnd();
+		if (is_io) {
+			pci_io_write32(base + 4 * i, shadow[i]);
+		} else {
+			pci_mem_write32(base + 4 * i, shadow[i]);
+		}
+	}
+
+	pci_stats_reset();
+	uint32_t mark = timing_now();
+	for (uint32_t op = 0; op < ops; op++) {
+		uint32_t x = rnd();
+		uint16_t idx = (x >> 8) % dwords;
+		switch (x & 0b111) {
+		case 0: case 1: case 2:
+			op_read(x, idx);
+			break;
+		case 3: case 4: case 5:
+			op_write(x, idx);
+			break;
+		default:
+			/* no bursts to I/O space */
+			if (is_io) {
+				op_read(x, idx);
+			} else {
+				op_burst(x, idx, dwords);
+			}
+			break;
+		}
+
+		/* timing_now() wraps after a few minutes, a soak runs longer */
+		uint32_t now = timing_now();
+		r->cycles += now - mark;
+		mark = now;
+	}
+
+	return 1;
+}
+
+static void dump_latency(const struct exerciser_latency *l) {
+	if (!l->count) {
+		console_fstr("-");
+		return;
+	}
+	console_dec16(l->min);
+	console_fstr("/");
+	console_dec16(l->sum / l->count);
+	console_fstr("/");
+	console_dec16(l->max);
+}
+
+/* latencies are min/avg/max CPU cycles per transaction */
+void exerciser_dump(const struct exerciser_report *r) {
+	console_fstr("\nTX ");
+	console_hex32(r->transactions);
+	console_fstr(" DW ");
+	console_hex32(r->dwords);
+	console_fstr("\nin ");
+	timing_print(r->cycles > 0xffffffff ? 0xffffffff : r->cycles);
+	if (r->cycles) {
+		console_fstr(" ");
+		console_hex32((uint64_t)r->transactions * F_CPU / r->cycles);
+		console_fstr("/s");
+	}
+	console_fstr("\nErr ");
+	console_hex32(r->mismatches);
+	console_fstr(" short ");
+	console_hex32(r->short_bursts);
+	console_fstr("\nR ");
+	dump_latency(&r->latency[EXERCISER_LATENCY_READ]);
+	console_fstr("\nW ");
+	dump_latency(&r->latency[EXERCISER_LATENCY_WRITE]);
+	console_fstr("\nB ");
+	dump_latency(&r->latency[EXERCISER_LATENCY_BURST]);
+	console_fstr("\n");
+	pci_stats_dump();
+}
@@ -0,0 +1,33 @@
+#ifndef EXERCISER_H
+#define EXERCISER_H
+
+#include <stdint.h>
+#include "pci/device.h"
+
+/* largest window that can be checked, one shadow dword each */
+#define EXERCISER_MAX_DWORDS 128
+
+#define EXERCISER_LATENCY_READ  0
+#define EXERCISER_LATENCY_WRITE 1
+#define EXERCISER_LATENCY_BURST 2
+
+struct exerciser_latency {
+	uint16_t min;  /* CPU cycles */
+	uint16_t max;
+	uint32_t count;
+	uint64_t sum;
+};
+
+struct exerciser_report {
+	uint32_t transactions;
+	uint32_t dwords;        /* incl. every dword of a burst */
+	uint32_t mismatches;    /* read back something else than written */
+	uint32_t short_bursts;  /* transferred less than asked for */
+	uint64_t cycles;
+	struct exerciser_latency latency[3];
+};
+
+uint8_t exerciser_run(const struct pci_dev *dev, uint8_t bar, uint16_t offset, uint16_t dwords, uint32_t ops, uint32_t seed, struct exerciser_report *r);
+void exerciser_dump(const struct exerciser_report *r);
+
+#endif
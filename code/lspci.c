@@ -2,6 +2,9 @@
 #include "pci/panic.h"
 #include "pci/registers.h"
 
+#include "drivers.h"
+#include "lspci.h"
+
 #include "console.h"
 #include <util/delay.h>
 
@@ -17,40 +20,27 @@ static void identify_subdevice_generic(uint32_t vpid, uint32_t svpid) {
 	}
 }
 
-static void identify_device(uint32_t vpid, uint32_t svpid) {
-	if (vpid == 0x816910ec) {
-		identify_subdevice_generic(vpid, svpid);
-		console_fstr("RTL8169/8110 GBE    ");
-	} else if (vpid == 0x813910ec) {
-		identify_subdevice_generic(vpid, svpid);
-		console_fstr("RTL8139/8100/1L 100M");
-	} else if (vpid == 0x00351033 && svpid == 0x010514c2) {
-		console_fstr("USB2.0 Host PTI-205N");
-	} else if (vpid == 0x000210b6) {
-		/* no sub ID, values appear useless (eeeb:dbaf here) */
-		console_fstr("Madge 16/4 Ringnode\n");
-	} else if (vpid == 0x30381106) {
-		identify_subdevice_generic(vpid, svpid);
-		console_fstr("USB1.1 Host VIA VT82");
-	} else if (vpid == 0x12161113 && svpid == vpid) {
-		console_fstr("Accton EN1207F\n");
-	} else if (vpid == 0x20311904) {
-		identify_subdevice_generic(vpid, svpid);
-		console_fstr("Silan SC92031\n");
-	} else if (vpid == 0x30441106) {
-		identify_subdevice_generic(vpid, svpid);
-		console_fstr("Firewire VIA VT63xx ");
+static void identify_device(const struct pci_dev *dev) {
+	uint32_t vpid = dev->devvendor;
+	uint32_t svpid = dev->subvendor;
+	const __flash struct pci_id *id = pci_id_lookup(dev);
+
+	if (id) {
+		if (id->flags & PCI_ID_SUBSYS) {
+			identify_subdevice_generic(vpid, svpid);
+		}
+		_console_fstr(id->name);
 	} else {
 		uint16_t vendor = vpid & 0xffff;
-		uint16_t dev = (vpid >> 16) & 0xffff;
+		uint16_t device = (vpid >> 16) & 0xffff;
 		uint16_t svendor = svpid & 0xffff;
 		uint16_t sdev = (svpid >> 16) & 0xffff;
 
 		console_hex16(vendor);
 		console_fstr(":");
-		console_hex16(dev);
+		console_hex16(device);
 
-		if ((vendor != svendor) || (dev != sdev)) {
+		if ((vendor != svendor) || (device != sdev)) {
 			console_fstr("/");
 			console_hex16(svendor);
 			console_fstr(":");
@@ -59,21 +49,19 @@ static void identify_device(uint32_t vpid, uint32_t svpid) {
 	}
 }
 
-void lspci_init() {
-	/* configuration read, full dword, offset 0 */
-	uint32_t vpid = pci_config_read32(PCIR_DEVVENDOR);
-	uint32_t svpid = pci_config_read32(PCIR_SUBVEND_0);
-
-	identify_device(vpid, svpid);
+void lspci(const struct pci_dev *dev) {
+	identify_device(dev);
 
 	/* BARs */
 	uint32_t bar_rb;
 	uint8_t bar_ct = 0;
-	for (uint8_t bar_no = 0; bar_no <= PCIR_MAX_BAR_0; bar_no++) {
+	for (uint8_t bar_no = 0; bar_no < dev->nbars; bar_no++) {
 		uint8_t bv = PCIR_BAR(bar_no);
-		pci_config_write32(bv, 0xffffffff);
-		bar_rb = pci_config_read32(bv);
-		if (!(bar_rb & 0x80000000)) {
+		bar_rb = dev->bar_size[bar_no];
+		if (pci_bar_is_upper(dev, bar_no)) {
+			continue;
+		}
+		if (!pci_bar_is64(dev, bar_no) && !(bar_rb & 0x80000000)) {
 			/* either not valid or the device actually demands
 			 * 4G of IO space, which we will just refuse then
 			 */
@@ -100,7 +88,8 @@ void lspci_init() {
 
 		console_fstr(" ");
 
-		uint8_t size = __builtin_ctz(bar_rb & ~((uint32_t) 0b1111));
+		uint64_t bar_size = pci_bar_size(dev, bar_no);
+		uint8_t size = bar_size ? __builtin_ctzll(bar_size) : 40;
 		const char *names[] = {
 			"1b", "2b", "4b", "8b",
 			"16b", "32b", "64b", "128b",
@@ -110,9 +99,36 @@ void lspci_init() {
 			"1M", "2M", "4M", "8M",
 			"16M", "32M", "64M", "128M",
 			"256M", "512M", "1G", "2G",
-			"4G"
+			"4G", "8G", "16G", "32G",
+			"64G", "128G", "256G", "512G",
 		};
-		console_str(names[size]);
+		console_str(size < sizeof(names) / sizeof(names[0]) ? names[size] : "??");
+	}
+
+	/* capabilities */
+	static const __flash char cap_names[PCI_MAX_CAP + 1][4] = {
+		[PCIY_PMG] = "PM",   [PCIY_AGP] = "AGP",   [PCIY_VPD] = "VPD",
+		[PCIY_SLOTID] = "Slt", [PCIY_MSI] = "MSI", [PCIY_CHSWP] = "HSw",
+		[PCIY_PCIX] = "PCX", [PCIY_HT] = "HT",     [PCIY_VENDOR] = "Vnd",
+		[PCIY_DEBUG] = "Dbg", [PCIY_CRES] = "CRC", [PCIY_HOTPLUG] = "HP",
+		[PCIY_SUBVENDOR] = "SV", [PCIY_AGP8X] = "AG8", [PCIY_SECDEV] = "Sec",
+		[PCIY_EXPRESS] = "PCE", [PCIY_MSIX] = "MSX", [PCIY_SATA] = "SAT",
+		[PCIY_PCIAF] = "AF",
+	};
+	uint8_t cap_ct = 0;
+	for (uint8_t id = 1; id <= PCI_MAX_CAP; id++) {
+		uint8_t off = pci_find_cap(dev, id);
+		if (!off) {
+			continue;
+		}
+		if (cap_ct++) {
+			console_fstr(" ");
+		} else {
+			console_fstr("\nCap ");
+		}
+		_console_fstr(cap_names[id]);
+		console_fstr("@");
+		console_hex8(off);
 	}
 }
 
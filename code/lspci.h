@@ -1,6 +1,8 @@
 #ifndef LSPCI_H
 #define LSPCI_H
 
-void lspci_init();
+#include "pci/device.h"
+
+void lspci(const struct pci_dev *dev);
 
 #endif
@@ -6,67 +6,109 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <setjmp.h>
 
+#include "boot.h"
 #include "console.h"
+#include "diag.h"
+#include "events.h"
 #include "timing.h"
 
+#include "pci/arbiter.h"
+#include "pci/device.h"
+#include "pci/flight.h"
 #include "pci/pci.h"
 #include "pci/registers.h"
 #include "pci/signals.h"
 #include "pci/panic.h"
+#include "pci/pins.h"
+#include "pci/recover.h"
 
-#include "lspci.h"
-#include "rtl8139.h"
-#include "rtl8169.h"
+#include "drivers.h"
 
+/* runs in the middle of whatever we are doing, possibly a transaction, so
+ * it only takes note. events_drain() prints it later.
+ */
 ISR(PCINT2_vect) {
 	uint8_t pk = PINK;
-	console_fstr("*ERR changed:");
-	if (!(pk & (1 << 1))) {
-		console_fstr(" P");
-	}
-	if (!(pk & (1 << 2))) {
-		console_fstr(" S");
-	}
-	console_fstr("\n");
-}
-
-ISR(PCINT0_vect) {
-	uint8_t pb = PINB;
-	if (!(pb & (1 << 0))) {
-		console_fstr("REQ BUS\n");
+	if ((pk & (PK_PERR | PK_SERR)) != (PK_PERR | PK_SERR)) {
+		event_count_err(pk);
+		event_push(EVENT_ERR, pk);
 	}
 }
 
-void main() {
-	console_reset();
-
+static void start_timing() {
 	timing_init();
 	sei();
+}
 
+/* the LCD initializes itself from its timer, this only queues */
+static void start_console() {
+	console_reset();
 	console_fstr("I'M ALIVE\n");
+	flight_report();
+}
 
-	initialize_bus();
+static void start_arbiter() {
+	arbiter_init(ARB_PRIORITY);
 
-	PCMSK0 |= (1 << PCINT0);
 	PCMSK2 = (1 << PCINT17) | (1 << PCINT18);
-	PCICR |= (1 << PCIE0) | (1 << PCIE2);
+	PCICR |= (1 << PCIE2);
 
 	console_fstr("PCI Bus initialized\n");
+}
+
+enum { BOOT_TIMING, BOOT_BUS_RESET, BOOT_CONSOLE, BOOT_ARBITER };
+
+/* RST# is held while the console comes up, and the warm-up clocks after
+ * it run on while enumeration already tries
+ */
+static const __flash struct boot_step boot_steps[] = {
+	[BOOT_TIMING]    = { 0, start_timing, 0 },
+	[BOOT_BUS_RESET] = { 1 << BOOT_TIMING, pci_reset_start, pci_reset_done },
+	[BOOT_CONSOLE]   = { 1 << BOOT_TIMING, start_console, 0 },
+	[BOOT_ARBITER]   = { (1 << BOOT_BUS_RESET) | (1 << BOOT_CONSOLE), start_arbiter, 0 },
+};
+
+void main() {
+	boot_run(boot_steps, sizeof(boot_steps) / sizeof(boot_steps[0]));
 
-	/* device present?! yes we read this twice, but whatever */
-	uint32_t pvid = pci_config_read32(PCIR_DEVVENDOR);
-	if (pvid == 0xffffffff) {
-		panic("/no device");
-	} else if (pvid == 0x813910ec) {
-		rtl8139_init();
-	} else if (pvid == 0x816910ec) {
-		rtl8169_init();
-	} else {
-		lspci_init();
+	if (!pci_enumerate()) {
+		halt("/no device");
+	}
+	/* when RST# was released, and how long the card took from there to
+	 * answer its first config read
+	 */
+	uint32_t rst = timing_mark_get(TIMING_RST_RELEASED);
+	console_fstr("RST ");
+	timing_print(rst);
+	console_fstr(" +");
+	timing_print(timing_mark_get(TIMING_FIRST_CONFIG) - rst);
+	console_fstr("\n");
+
+	/* pci_fail() comes back here */
+	pci_recover_armed = 1;
+	if (setjmp(pci_recover_jmp)) {
+		if (!pci_reinit()) {
+			panic("/device gone");
+		}
+	}
+#ifdef DIAG_SUPPORT
+	diag_run();
+#else
+	drivers_attach();
+#endif
+	events_drain();
+	arbiter_idle();
+
+	/* the transaction engine does not print errors itself */
+	uint8_t err = pci_take_error();
+	if (err) {
+		console_fstr("\nPCI error ");
+		console_hex8(err);
 	}
 
-	panic("/done");
+	halt("/done");
 }
 
 
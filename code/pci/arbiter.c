@@ -0,0 +1,206 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <stdint.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "console.h"
+#include "timing.h"
+#include "pci/arbiter.h"
+#include "pci/device.h"
+#include "pci/panic.h"
+#include "pci/pins.h"
+#include "pci/recover.h"
+#include "pci/signals.h"
+
+/* central arbiter for our one slot.
+ * there are only two masters, us and the card, and REQ#/GNT# are the
+ * card's. the card gets GNT# from the pin change interrupt as soon as it
+ * asserts REQ#, or at the end of our transaction if one is running.
+ * while nobody wants it, the bus is parked on us: AD, C/BE# and PAR are
+ * driven low (which is even parity) instead of floating.
+ */
+
+volatile uint8_t arb_busy = 0;
+volatile uint8_t arb_owner = ARB_HOST;
+
+static enum arb_policy policy;
+static uint32_t req_time;
+static uint32_t grant_time;
+static struct arb_stats stats;
+
+/* how long the card may keep the bus after its own transaction started,
+ * in clocks. a bit more than its latency timer for the last data phase.
+ */
+#define ARB_RELEASE_CLOCKS (PCI_LAT_TIMER + 64)
+
+/* tristating clears the port bits, so this drives zeros */
+static void park() {
+	ad_output_mode();
+	cbe_output_mode();
+	par_output_mode();
+}
+
+static void unpark() {
+	ad_tristate();
+	cbe_tristate();
+	par_tristate();
+}
+
+/* interrupts have to be disabled */
+static void grant() {
+	unpark();
+	gnt_assert();
+	arb_owner = ARB_CARD;
+
+	grant_time = timing_now();
+	uint32_t latency = grant_time - req_time;
+	stats.grants++;
+	stats.grant_latency += latency;
+	if (latency > stats.grant_latency_max) {
+		stats.grant_latency_max = latency;
+	}
+}
+
+ISR(PCINT0_vect) {
+	if (!(PINB & PB_REQ)) {
+		if (arb_owner != ARB_CARD) {
+			req_time = timing_now();
+			if (!arb_busy) {
+				grant();
+			}
+		}
+	} else if (arb_owner == ARB_CARD) {
+		/* done, but its last transaction may still be running */
+		gnt_deassert();
+		arb_owner = ARB_LEAVING;
+	}
+}
+
+void arbiter_init(enum arb_policy p) {
+	policy = p;
+	memset(&stats, 0, sizeof(stats));
+	arbiter_reset();
+
+	PCMSK0 |= (1 << PCINT0);
+	PCICR |= (1 << PCIE0);
+}
+
+/* after a bus reset, which may have happened in the middle of anything */
+void arbiter_reset() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		gnt_deassert();
+		park();
+		arb_owner = ARB_HOST;
+		arb_busy = 0;
+	}
+}
+
+void arbiter_set_policy(enum arb_policy p) {
+	policy = p;
+}
+
+/* after GNT# was taken away. the card may start a transaction on the edge
+ * it last saw GNT# on, and it keeps driving AD for the turnaround clock
+ * after it is done.
+ */
+void arbiter_wait_idle() {
+	__builtin_avr_delay_cycles(2 * CPU_CYCLES_PER_CLK);
+
+	uint32_t since = timing_now();
+	while ((PINF & (PF_FRAME | PF_IRDY)) != (PF_FRAME | PF_IRDY)) {
+		if (timing_elapsed(since) > (uint32_t)ARB_RELEASE_CLOCKS * CPU_CYCLES_PER_CLK) {
+			pci_fail("Card holds bus");
+		}
+	}
+
+	__builtin_avr_delay_cycles(CPU_CYCLES_PER_CLK);
+}
+
+/* get the bus back for one of our transactions, arb_busy keeps the
+ * interrupt from granting it again
+ */
+void arbiter_take() {
+	uint32_t start = timing_now();
+
+	if (arb_owner == ARB_CARD) {
+		/* let it have its turn first. round robin ends it as soon as a
+		 * transaction has started, removing GNT# does not cut that one
+		 * short.
+		 */
+		uint32_t turn = (uint32_t)PCI_LAT_TIMER * CPU_CYCLES_PER_CLK;
+		while (!(PINB & PB_REQ) && timing_elapsed(grant_time) < turn) {
+			if (policy == ARB_ROUND_ROBIN && !(PINF & PF_FRAME)) {
+				break;
+			}
+		}
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (arb_owner == ARB_CARD) {
+				gnt_deassert();
+				arb_owner = ARB_LEAVING;
+				if (!(PINB & PB_REQ)) {
+					/* still wants it, gets it again after us */
+					stats.preemptions++;
+					req_time = timing_now();
+				}
+			}
+		}
+	}
+
+	arbiter_wait_idle();
+	arb_owner = ARB_HOST;
+	stats.host_wait += timing_elapsed(start);
+}
+
+/* end of our transaction(s): hand the bus over if the card is waiting,
+ * park it on us otherwise
+ */
+void arbiter_release() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		arb_busy = 0;
+		if (!(PINB & PB_REQ)) {
+			grant();
+		} else {
+			park();
+		}
+	}
+}
+
+/* from the main loops: once the card has given the bus back, park it on us
+ * until our next transaction instead of letting it float
+ */
+void arbiter_idle() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (arb_owner != ARB_LEAVING || arb_busy) {
+			return;
+		}
+		arb_busy = 1;
+	}
+
+	arbiter_wait_idle();
+	arb_owner = ARB_HOST;
+	arbiter_release();
+}
+
+void arbiter_stats_get(struct arb_stats *s) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy(s, &stats, sizeof(*s));
+	}
+}
+
+/* counts, then REQ# to GNT# average and maximum in cycles */
+void arbiter_dump() {
+	struct arb_stats s;
+	arbiter_stats_get(&s);
+
+	console_fstr("G");
+	console_hex16(s.grants);
+	console_fstr(" P");
+	console_hex16(s.preemptions);
+	console_fstr("\nLat ");
+	console_hex32(s.grants ? s.grant_latency / s.grants : 0);
+	console_fstr(" ");
+	console_hex32(s.grant_latency_max);
+	console_fstr("\nWait ");
+	console_hex32(s.host_wait);
+}
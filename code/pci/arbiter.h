@@ -0,0 +1,50 @@
+#ifndef PCI_ARBITER_H
+#define PCI_ARBITER_H
+
+#include <stdint.h>
+
+/* how the bus is shared between us and a bus mastering card */
+enum arb_policy {
+	/* the card gets one transaction per grant when we want the bus */
+	ARB_ROUND_ROBIN,
+	/* the card keeps the bus as long as it asserts REQ#, we only take it
+	 * back once its latency timer (PCI_LAT_TIMER) has run out
+	 */
+	ARB_PRIORITY,
+};
+
+enum arb_owner { ARB_HOST, ARB_CARD, ARB_LEAVING };
+
+/* all times in CPU cycles */
+struct arb_stats {
+	uint16_t grants;
+	uint16_t preemptions;       /* GNT# taken away while REQ# was asserted */
+	uint32_t grant_latency;     /* sum of REQ# to GNT# */
+	uint32_t grant_latency_max;
+	uint32_t host_wait;         /* cycles we waited for the card to get off the bus */
+};
+
+extern volatile uint8_t arb_busy;
+extern volatile uint8_t arb_owner;
+
+void arbiter_init(enum arb_policy policy);
+void arbiter_reset();
+void arbiter_set_policy(enum arb_policy policy);
+void arbiter_take();
+void arbiter_wait_idle();
+void arbiter_release();
+void arbiter_idle();
+void arbiter_stats_get(struct arb_stats *s);
+void arbiter_dump();
+
+/* around every transaction of ours. nothing to do unless the card had the
+ * bus in the meantime.
+ */
+static inline void arbiter_acquire() {
+	arb_busy = 1;
+	if (arb_owner != ARB_HOST) {
+		arbiter_take();
+	}
+}
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdint.h>
+#include <string.h>
+#include <util/delay.h>
+#include "timing.h"
+#include "pci/device.h"
+#include "pci/master_transaction.h"
+#include "pci/panic.h"
+#include "pci/pci.h"
+#include "pci/registers.h"
+#include "pci/signals.h"
+
+struct pci_dev pci_devs[PCI_MAX_FUNCTIONS];
+uint8_t pci_ndevs = 0;
+
+/* the clock keeps running meanwhile, 10ms are 2^16 or so PCI clocks */
+#define ENUM_RETRY_MS 10
+
+static uint8_t bars_for_hdrtype(uint8_t hdrtype) {
+	switch (hdrtype & PCIM_HDRTYPE) {
+	case PCIM_HDRTYPE_NORMAL: return PCI_MAX_BARS;
+	case PCIM_HDRTYPE_BRIDGE: return 2;
+	default: return 0;
+	}
+}
+
+/* walk the capability list once and remember where everything is.
+ * the list may be broken, so it is never followed for longer than there
+ * could possibly be entries.
+ */
+static void find_caps(struct pci_dev *dev) {
+	memset(dev->cap, 0, sizeof(dev->cap));
+	if (!(pci_config_read16(PCIR_STATUS) & PCIM_STATUS_CAPPRESENT)) {
+		return;
+	}
+
+	uint8_t ptr_reg = ((dev->hdrtype & PCIM_HDRTYPE) == PCIM_HDRTYPE_CARDBUS) ? PCIR_CAP_PTR_2 : PCIR_CAP_PTR;
+	uint8_t ptr = pci_config_read8(ptr_reg) & ~0b11;
+	for (uint8_t n = 0; ptr >= 0x40 && n < (256 - 0x40) / 4; n++) {
+		uint16_t hdr = pci_config_read16(ptr);
+		uint8_t id = hdr & 0xff;
+		if (id <= PCI_MAX_CAP && !dev->cap[id]) {
+			dev->cap[id] = ptr;
+		}
+		ptr = (hdr >> 8) & ~0b11;
+	}
+}
+
+/* what every function gets from us, independent of the driver */
+static void setup_function(const struct pci_dev *dev) {
+	/* needed for Memory Write and Invalidate, and it tells prefetching
+	 * targets how much to fetch
+	 */
+	if ((dev->hdrtype & PCIM_HDRTYPE) != PCIM_HDRTYPE_CARDBUS) {
+		pci_config_write8(PCIR_CACHELNSZ, PCI_CACHE_LINE);
+	}
+	pci_config_write8(PCIR_LATTIMER, PCI_LAT_TIMER);
+}
+
+static void size_bar(struct pci_dev *dev, uint8_t bar) {
+	uint8_t reg = PCIR_BAR(bar);
+	dev->bar_base[bar] = pci_config_read32(reg);
+	pci_config_write32(reg, 0xffffffff);
+	dev->bar_size[bar] = pci_config_read32(reg);
+	pci_config_write32(reg, dev->bar_base[bar]);
+}
+
+static uint8_t probe_function(uint8_t fn) {
+	pci_select_function(fn);
+
+	/* only the presence check may be Master Aborted or Retried, the
+	 * rest has to go through
+	 */
+	master_expect_abort(1);
+	uint32_t devvendor = pci_config_read32(PCIR_DEVVENDOR);
+	master_expect_abort(0);
+	if (devvendor == 0xffffffff) {
+		return 0;
+	}
+	timing_mark(TIMING_FIRST_CONFIG);
+
+	struct pci_dev *dev = &pci_devs[pci_ndevs++];
+	dev->fn = fn;
+	dev->devvendor = devvendor;
+	dev->hdrtype = pci_config_read8(PCIR_HDRTYPE);
+	dev->class = pci_config_read32(PCIR_REVID) >> 8;
+	dev->subvendor = pci_config_read32(PCIR_SUBVEND_0);
+	dev->nbars = bars_for_hdrtype(dev->hdrtype);
+
+	/* size all BARs now so that neither drivers nor lspci have to */
+	dev->bar64 = 0;
+	for (uint8_t bar = 0; bar < dev->nbars; bar++) {
+		size_bar(dev, bar);
+
+		/* a 64 bit BAR takes the next one for the high dword */
+		uint32_t size = dev->bar_size[bar];
+		if (PCI_BAR_MEM(size) && (size & PCIM_BAR_MEM_TYPE) == PCIM_BAR_MEM_64 && bar + 1 < dev->nbars) {
+			dev->bar64 |= 1 << bar;
+			size_bar(dev, ++bar);
+		}
+	}
+
+	find_caps(dev);
+	setup_function(dev);
+
+	return 1;
+}
+
+/* find all functions of the card in the slot.
+ * function 0 must exist, the others are only looked at if the card claims
+ * to be a multifunction device.
+ * this may run before the post-reset warm-up is over. until then, a card
+ * that does not answer yet is asked again a bit later.
+ */
+uint8_t pci_enumerate() {
+	pci_ndevs = 0;
+
+	uint8_t found;
+	while (!(found = probe_function(0)) && !pci_warmup_done()) {
+		_delay_ms(ENUM_RETRY_MS);
+	}
+	if (found && (pci_devs[0].hdrtype & PCIM_MFDEV)) {
+		for (uint8_t fn = 1; fn < PCI_MAX_FUNCTIONS; fn++) {
+			probe_function(fn);
+		}
+	}
+
+	pci_select_function(0);
+	return pci_ndevs;
+}
+
+/* after a bus reset: wait for the card to come back and program the BARs
+ * and everything else enumeration did again, from what was found the
+ * first time. the command register is left to the drivers' attach.
+ * returns 0 if function 0 does not answer (or is a different card now).
+ */
+uint8_t pci_restore() {
+	master_expect_abort(1);
+	pci_select_function(0);
+	uint8_t back;
+	while (!(back = (pci_config_read32(PCIR_DEVVENDOR) == pci_devs[0].devvendor)) && !pci_warmup_done()) {
+		_delay_ms(ENUM_RETRY_MS);
+	}
+	master_expect_abort(0);
+	if (!back) {
+		return 0;
+	}
+
+	for (uint8_t i = 0; i < pci_ndevs; i++) {
+		struct pci_dev *dev = &pci_devs[i];
+		pci_select(dev);
+		for (uint8_t bar = 0; bar < dev->nbars; bar++) {
+			pci_config_write32(PCIR_BAR(bar), dev->bar_base[bar]);
+		}
+		setup_function(dev);
+	}
+
+	pci_select_function(0);
+	return 1;
+}
+
+void pci_select(const struct pci_dev *dev) {
+	pci_select_function(dev->fn);
+}
+
+void pci_bar_assign(struct pci_dev *dev, uint8_t bar, uint32_t base) {
+	pci_select(dev);
+	pci_config_write32(PCIR_BAR(bar), base);
+	dev->bar_base[bar] = base;
+}
+
+void pci_bar_assign64(struct pci_dev *dev, uint8_t bar, uint64_t base) {
+	if (!pci_bar_is64(dev, bar)) {
+		if (base >> 32) {
+			panic("32 bit BAR above 4G");
+		}
+		pci_bar_assign(dev, bar, base);
+		return;
+	}
+
+	pci_bar_assign(dev, bar, base);
+	pci_config_write32(PCIR_BAR(bar + 1), base >> 32);
+	dev->bar_base[bar + 1] = base >> 32;
+}
+
+/* decoded size of a BAR, 0 if it is not implemented (or the high half) */
+uint64_t pci_bar_size(const struct pci_dev *dev, uint8_t bar) {
+	uint32_t lo = dev->bar_size[bar];
+	if (pci_bar_is_upper(dev, bar)) {
+		return 0;
+	}
+	if (PCI_BAR_IO(lo)) {
+		uint32_t mask = lo & PCIM_BAR_IO_BASE;
+		return mask ? (uint32_t)(~mask + 1) : 0;
+	}
+
+	uint64_t mask = lo & (uint32_t)PCIM_BAR_MEM_BASE;
+	if (!mask && !pci_bar_is64(dev, bar)) {
+		return 0;
+	}
+	mask |= pci_bar_is64(dev, bar) ? (uint64_t)dev->bar_size[bar + 1] << 32 : 0xffffffff00000000ULL;
+	return mask ? ~mask + 1 : 0;
+}
+
+/* which BAR of which function decodes addr, PCI_NO_BAR if none does */
+uint8_t pci_bar_lookup(uint32_t addr, uint8_t io, const struct pci_dev **devp) {
+	for (uint8_t i = 0; i < pci_ndevs; i++) {
+		const struct pci_dev *dev = &pci_devs[i];
+		for (uint8_t bar = 0; bar < dev->nbars; bar++) {
+			/* 32 bit addresses never hit anything above 4G */
+			if (pci_bar_is_upper(dev, bar) || (pci_bar_is64(dev, bar) && dev->bar_base[bar + 1])) {
+				continue;
+			}
+			uint32_t size = dev->bar_size[bar];
+			uint32_t mask;
+			if (PCI_BAR_IO(size)) {
+				if (!io) { continue; }
+				mask = size & PCIM_BAR_IO_BASE;
+			} else {
+				if (io) { continue; }
+				mask = size & (uint32_t)PCIM_BAR_MEM_BASE;
+			}
+			if (mask && dev->bar_base[bar] && !((addr ^ dev->bar_base[bar]) & mask)) {
+				if (devp) {
+					*devp = dev;
+				}
+				return bar;
+			}
+		}
+	}
+	return PCI_NO_BAR;
+}
@@ -0,0 +1,70 @@
+#ifndef PCI_DEVICE_H
+#define PCI_DEVICE_H
+
+#include <stdint.h>
+#include "pci/registers.h"
+
+#define PCI_MAX_FUNCTIONS 8
+#define PCI_MAX_BARS (PCIR_MAX_BAR_0 + 1)
+
+/* programmed into every function, in dwords. also what the burst code
+ * picks the memory commands by.
+ */
+#define PCI_CACHE_LINE 8
+
+/* also programmed into every function, in clocks. how long a bus master
+ * may keep the bus once the arbiter wants it back (pci/arbiter.c).
+ */
+#define PCI_LAT_TIMER 32
+
+#define PCI_NO_BAR 0xff
+
+/* capabilities are indexed by their PCIY_ number, higher ones (none of
+ * them make sense on a conventional PCI card) are not remembered
+ */
+#define PCI_MAX_CAP PCIY_PCIAF
+
+/* what we know about a function without asking it again.
+ * filled in once by pci_enumerate(), BAR bases are kept up to date by
+ * pci_bar_assign().
+ */
+struct pci_dev {
+	uint8_t fn;
+	uint8_t hdrtype;
+	uint8_t nbars;
+	uint32_t devvendor; /* PCIR_DEVVENDOR */
+	uint32_t subvendor; /* PCIR_SUBVEND_0 */
+	uint32_t class;     /* class, subclass, progif (PCIR_REVID dword >> 8) */
+	/* a 64 bit BAR has its high dwords in the next entry */
+	uint32_t bar_size[PCI_MAX_BARS]; /* readback after writing all 1 */
+	uint32_t bar_base[PCI_MAX_BARS];
+	uint8_t bar64;                   /* bit n: BAR n is a 64 bit BAR */
+	uint8_t cap[PCI_MAX_CAP + 1]; /* config offset by PCIY_xxx, 0 = none */
+};
+
+extern struct pci_dev pci_devs[PCI_MAX_FUNCTIONS];
+extern uint8_t pci_ndevs;
+
+uint8_t pci_enumerate();
+uint8_t pci_restore();
+void pci_select(const struct pci_dev *dev);
+void pci_bar_assign(struct pci_dev *dev, uint8_t bar, uint32_t base);
+void pci_bar_assign64(struct pci_dev *dev, uint8_t bar, uint64_t base);
+uint64_t pci_bar_size(const struct pci_dev *dev, uint8_t bar);
+uint8_t pci_bar_lookup(uint32_t addr, uint8_t io, const struct pci_dev **devp);
+
+static inline uint8_t pci_bar_is64(const struct pci_dev *dev, uint8_t bar) {
+	return dev->bar64 & (1 << bar);
+}
+
+/* the high half of a 64 bit BAR */
+static inline uint8_t pci_bar_is_upper(const struct pci_dev *dev, uint8_t bar) {
+	return bar && (dev->bar64 & (1 << (bar - 1)));
+}
+
+/* config offset of a capability, 0 if the function does not have it */
+static inline uint8_t pci_find_cap(const struct pci_dev *dev, uint8_t id) {
+	return (id <= PCI_MAX_CAP) ? dev->cap[id] : 0;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include <avr/eeprom.h>
+#include <stdint.h>
+#include <string.h>
+#include "console.h"
+#include "trace.h"
+#include "pci/flight.h"
+
+struct flight_rec flight_ring[FLIGHT_RECORDS];
+uint8_t flight_head = 0;
+
+/* what panic() leaves for the next boot. eeprom_update_block() only
+ * writes the bytes that changed, at 3.4ms each that matters.
+ */
+#define FLIGHT_MAGIC 0x4652
+
+struct flight_saved {
+	uint16_t magic;
+	uint8_t head;
+	char msg[FLIGHT_MSG_LEN];
+	struct flight_rec ring[FLIGHT_RECORDS];
+};
+
+static struct flight_saved EEMEM saved;
+
+/* interrupts are off, nothing is going to add records anymore */
+void flight_save(const char *msg) {
+	char m[FLIGHT_MSG_LEN] = { 0 };
+	strncpy(m, msg, sizeof(m));
+
+	eeprom_update_block(flight_ring, saved.ring, sizeof(flight_ring));
+	eeprom_update_byte(&saved.head, flight_head);
+	eeprom_update_block(m, saved.msg, sizeof(m));
+	/* last, so that a half written one does not count */
+	eeprom_update_word(&saved.magic, FLIGHT_MAGIC);
+}
+
+static void print_rec(const struct flight_rec *r) {
+#if defined(TRACE_SUPPORT)
+	trace_event(TRACE_FLIGHT, r, sizeof(*r));
+#elif defined(CONSOLE_SUPPORT)
+	console_hex32(r->time);
+	console_char(' ');
+	console_hex8(r->cmd_be);
+	console_char(' ');
+	console_hex32(r->addr);
+	console_char(' ');
+	console_hex32(r->data);
+	console_char(' ');
+	console_hex8(r->status);
+	console_char('\n');
+#endif
+}
+
+/* at boot: print what the last panic() left, oldest record first, and
+ * forget about it. the LCD alone only has room for the newest one.
+ */
+void flight_report() {
+	if (eeprom_read_word(&saved.magic) != FLIGHT_MAGIC) {
+		return;
+	}
+
+	char m[FLIGHT_MSG_LEN + 1];
+	eeprom_read_block(m, saved.msg, FLIGHT_MSG_LEN);
+	m[FLIGHT_MSG_LEN] = 0;
+	console_fstr("last panic: ");
+	console_str(m);
+	console_char('\n');
+
+	uint8_t head = eeprom_read_byte(&saved.head);
+	for (uint8_t i = 0; i < FLIGHT_RECORDS; i++) {
+		struct flight_rec r;
+		eeprom_read_block(&r, &saved.ring[(head + i) & (FLIGHT_RECORDS - 1)], sizeof(r));
+		/* never used since boot */
+		if (r.time == 0 && r.cmd_be == 0) {
+			continue;
+		}
+#ifndef UART_SUPPORT
+		if (i != FLIGHT_RECORDS - 1) {
+			continue;
+		}
+#endif
+		print_rec(&r);
+	}
+
+	eeprom_update_word(&saved.magic, 0xffff);
+}
@@ -0,0 +1,39 @@
+#ifndef PCI_FLIGHT_H
+#define PCI_FLIGHT_H
+
+#include <stdint.h>
+#include "timing.h"
+
+/* flight recorder: the last few transactions, always on.
+ * panic() saves it to the EEPROM, the next boot prints it.
+ */
+
+#define FLIGHT_RECORDS 16 /* power of 2 */
+#define FLIGHT_MSG_LEN 20
+
+struct flight_rec {
+	uint32_t time;   /* timing_now() at the end of it */
+	uint32_t addr;
+	uint32_t data;   /* the first dword of a burst */
+	uint8_t cmd_be;  /* command << 4 | byte enables */
+	uint8_t status;  /* enum master_status */
+};
+
+extern struct flight_rec flight_ring[FLIGHT_RECORDS];
+extern uint8_t flight_head;
+
+/* the cost of one of these is mostly timing_now() */
+static inline void flight_record(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t data, uint8_t status) {
+	struct flight_rec *r = &flight_ring[flight_head];
+	r->time = timing_now();
+	r->addr = addr;
+	r->data = data;
+	r->cmd_be = (cmd << 4) | (be & 0xf);
+	r->status = status;
+	flight_head = (flight_head + 1) & (FLIGHT_RECORDS - 1);
+}
+
+void flight_save(const char *msg);
+void flight_report();
+
+#endif
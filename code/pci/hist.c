@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "console.h"
+#include "pci/commands.h"
+#include "pci/device.h"
+#include "pci/hist.h"
+#include "pci/registers.h"
+
+#ifdef PCI_HIST
+
+static struct pci_hist hist;
+
+static uint8_t bucket(uint8_t clocks) {
+	uint8_t b = 0;
+	while (clocks && b < HIST_BUCKETS - 1) {
+		b++;
+		clocks >>= 1;
+	}
+	return b;
+}
+
+static uint8_t space_of(uint8_t cmd) {
+	switch (cmd) {
+	case CMD_CONFIG_READ: case CMD_CONFIG_WRITE: return HIST_CONFIG;
+	case CMD_IO_READ: case CMD_IO_WRITE: return HIST_IO;
+	default: return HIST_MEM;
+	}
+}
+
+/* which BAR (of any function) decodes addr */
+static uint8_t target_of(uint32_t addr, uint8_t space) {
+	if (space == HIST_CONFIG) {
+		return HIST_TARGETS - 1;
+	}
+
+	uint8_t bar = pci_bar_lookup(addr, space == HIST_IO, 0);
+	return (bar == PCI_NO_BAR) ? HIST_TARGETS - 1 : bar;
+}
+
+void pci_hist_record(uint32_t addr, uint8_t cmd, uint8_t devsel, uint8_t trdy) {
+	uint8_t space = space_of(cmd);
+	struct hist_pair *s = &hist.space[space];
+	struct hist_pair *t = &hist.target[target_of(addr, space)];
+	uint8_t bd = bucket(devsel), bt = bucket(trdy);
+
+	/* saturate instead of wrapping around */
+	if (s->devsel[bd] != 0xffff) { s->devsel[bd]++; }
+	if (s->trdy[bt] != 0xffff) { s->trdy[bt]++; }
+	if (t->devsel[bd] != 0xffff) { t->devsel[bd]++; }
+	if (t->trdy[bt] != 0xffff) { t->trdy[bt]++; }
+}
+
+void pci_hist_snapshot(struct pci_hist *h) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy(h, &hist, sizeof(*h));
+	}
+}
+
+void pci_hist_reset() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memset(&hist, 0, sizeof(hist));
+	}
+}
+
+static void dump_buckets(const uint16_t *b) {
+	for (uint8_t i = 0; i < HIST_BUCKETS; i++) {
+		console_hex16(b[i]);
+	}
+}
+
+static void dump_pair(const struct hist_pair *p) {
+	console_fstr("\nD");
+	dump_buckets(p->devsel);
+	console_fstr("\nT");
+	dump_buckets(p->trdy);
+}
+
+/* every histogram that saw anything, a label line ("C"onfig, "I"/O, "M"em,
+ * "B"AR n or "B-" for no BAR) followed by the DEVSEL and the TRDY buckets
+ */
+void pci_hist_dump() {
+	struct pci_hist h;
+	pci_hist_snapshot(&h);
+
+	for (uint8_t i = 0; i < HIST_SPACES + HIST_TARGETS; i++) {
+		const struct hist_pair *p = (i < HIST_SPACES) ? &h.space[i] : &h.target[i - HIST_SPACES];
+
+		uint16_t any = 0;
+		for (uint8_t b = 0; b < HIST_BUCKETS; b++) {
+			any |= p->devsel[b];
+		}
+		if (!any) {
+			continue;
+		}
+
+		console_fstr("\n");
+		if (i < HIST_SPACES) {
+			console_char("CIM"[i]);
+		} else if (i - HIST_SPACES < PCI_MAX_BARS) {
+			console_char('B');
+			console_char('0' + i - HIST_SPACES);
+		} else {
+			console_fstr("B-");
+		}
+		dump_pair(p);
+	}
+}
+
+#else
+
+void pci_hist_snapshot(struct pci_hist *h) {
+	memset(h, 0, sizeof(*h));
+}
+
+void pci_hist_reset() {
+}
+
+void pci_hist_dump() {
+	console_fstr("no PCI_HIST");
+}
+
+#endif
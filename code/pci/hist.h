@@ -0,0 +1,39 @@
+#ifndef PCI_HIST_H
+#define PCI_HIST_H
+
+#include <stdint.h>
+#include "pci/device.h"
+
+/* DEVSEL# and TRDY# latency histograms, built with -DPCI_HIST.
+ * bucket n counts latencies of [2^(n-1), 2^n) PCI clocks, bucket 0 is no
+ * wait at all. the last bucket takes everything above.
+ */
+#define HIST_BUCKETS 5
+
+enum hist_space { HIST_CONFIG, HIST_IO, HIST_MEM, HIST_SPACES };
+
+/* one per BAR, plus one for addresses outside of all BARs */
+#define HIST_TARGETS (PCI_MAX_BARS + 1)
+
+struct hist_pair {
+	uint16_t devsel[HIST_BUCKETS];
+	uint16_t trdy[HIST_BUCKETS];
+};
+
+struct pci_hist {
+	struct hist_pair space[HIST_SPACES];
+	struct hist_pair target[HIST_TARGETS];
+};
+
+#ifdef PCI_HIST
+void pci_hist_record(uint32_t addr, uint8_t cmd, uint8_t devsel, uint8_t trdy);
+#define HIST_RECORD(addr, cmd, devsel, trdy) pci_hist_record(addr, cmd, devsel, trdy)
+#else
+#define HIST_RECORD(addr, cmd, devsel, trdy) do { (void)(devsel); (void)(trdy); } while (0)
+#endif
+
+void pci_hist_snapshot(struct pci_hist *h);
+void pci_hist_reset();
+void pci_hist_dump();
+
+#endif
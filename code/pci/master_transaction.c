@@ -1,9 +1,16 @@
 #include <avr/io.h>
-#include <util/delay.h>
 #include <stdint.h>
-#include "console.h"
+#include "pci/commands.h"
+#include "trace.h"
+#include "pci/arbiter.h"
+#include "pci/flight.h"
+#include "pci/master_transaction.h"
 #include "pci/signals.h"
 #include "pci/panic.h"
+#include "pci/recover.h"
+#include "pci/hist.h"
+#include "pci/stats.h"
+#include "pci/wave.h"
 
 static uint8_t ad_cbe_parity(uint32_t addr, uint8_t cbe) {
 	/* even number of ones in addr, cbe, par */
@@ -13,7 +20,7 @@ static uint8_t ad_cbe_parity(uint32_t addr, uint8_t cbe) {
 static void sanity_deasserted_devsel_trdy() {
 	/* sanity check: DEVSEL and TRDY should now be deasserted */
 	if (is_devsel_asserted() || is_trdy_asserted()) {
-		panic("DEVSEL or TRDY still asserted");
+		pci_fail("DEVSEL or TRDY still asserted");
 	}
 }
 
@@ -21,13 +28,86 @@ static void sanity_deasserted_frame_irdy() {
 	/* sanity check: FRAME and IRDY should not be asserted because the
 	 * bus is idle */
 	if (is_frame_asserted() || is_irdy_asserted()) {
-		panic("FRAME or IRDY asserted on idle bus");
+		pci_fail("FRAME or IRDY asserted on idle bus");
 	}
 }
 
 enum _rw_type { READ_TRANSACTION, WRITE_TRANSACTION };
 
-__attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t value, enum _rw_type type) {
+/* set during bus enumeration, where a Master Abort just means that there is
+ * no such function and is nothing to complain about. a Target Retry is
+ * fine there too, the card may still be busy initializing after reset.
+ * both return all ones, like a missing function does.
+ */
+static uint8_t abort_expected = 0;
+
+void master_expect_abort(uint8_t expected) {
+	abort_expected = expected;
+}
+
+/* set to have the next transaction assert LOCK# */
+static uint8_t lock_next = 0;
+
+/* rising edges of the last single transaction, for polling */
+static uint8_t transaction_clocks;
+static uint8_t transaction_status;
+
+/* errors the caller asked for (Master Abort and Retry during enumeration)
+ * do not count
+ */
+uint8_t master_status() {
+	if (abort_expected && transaction_status != MASTER_PARITY) {
+		return MASTER_OK;
+	}
+	return transaction_status;
+}
+
+/* a data parity error on a read is signalled on PERR# two clocks after
+ * the data phase, for one clock. once it has been seen, perr_clock() goes
+ * after every falling edge until it is done.
+ */
+static uint8_t perr_state = 0;
+
+static void perr_clock() {
+	switch (perr_state) {
+	case 3: assert_perr(); break;
+	case 2: deassert_perr_1(); break;
+	case 1: deassert_perr_2(); break;
+	}
+	perr_state--;
+}
+
+#define PERR_CLOCK() do { if (perr_state) { perr_clock(); } } while (0)
+
+static void parity_error() {
+	STATS_INC(parity_errors);
+	transaction_status = MASTER_PARITY;
+	perr_state = 3;
+}
+
+/* extra clocks after the bus went idle, if PERR# is not done yet */
+static void perr_finish() {
+	while (perr_state) {
+		WAVE_SAMPLE(0);
+		clk_high();
+		clk_low();
+		perr_clock();
+	}
+}
+
+/* after a bus reset */
+void master_reset() {
+	abort_expected = 0;
+	lock_next = 0;
+	perr_state = 0;
+	transaction_status = MASTER_OK;
+}
+
+/* addr_par is passed in so that polling loops only compute it once.
+ * a nonzero addr_hi makes it a Dual Address Cycle, addr_par is not used
+ * then. everyone else passes a constant 0, which leaves no trace of it.
+ */
+__attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr, uint32_t addr_hi, uint8_t cmd, uint8_t be, uint32_t value, enum _rw_type type, uint8_t addr_par) {
 	/* this should never happen!
 	 * additionally, this shouldn't even happen when support for multiple
 	 * cards is added
@@ -37,8 +117,11 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 	 */
 	sanity_deasserted_frame_irdy();
 
+	STATS_INC(by_cmd[cmd & 0xf]);
+
 	/* Address phase */
 
+	WAVE_SAMPLE(WAVE_START);
 	clk_high();
 	clk_low();
 	assert_frame();
@@ -46,14 +129,31 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 	ad_output_mode();
 	ad_set(addr);
 	cbe_output_mode();
-	cbe_set(cmd);
-	uint8_t addr_par = ad_cbe_parity(addr, cmd);
+	if (addr_hi) {
+		/* low dword with the DAC command first, then the high dword
+		 * with the real command. the target decodes from the second
+		 * one on, so DEVSEL# timing is the same as usual after that.
+		 */
+		cbe_set(CMD_DUAL_ADDRESS);
+		WAVE_SAMPLE(0);
+		clk_high();
+		ad_set(addr_hi);
+		cbe_set(cmd);
+		clk_low();
+		par_output_mode();
+		par_set(ad_cbe_parity(addr, CMD_DUAL_ADDRESS));
+		addr_par = ad_cbe_parity(addr_hi, cmd);
+		STATS_ADD(busy_clocks, 1);
+	} else {
+		cbe_set(cmd);
+	}
 
 	/* prepare for the first data phase
 	 * we assert IRDY, because we are ready to transfer the first data word
 	 * we deassert FRAME, because it is going to be the last data word
 	 */
 
+	WAVE_SAMPLE(0);
 	clk_high();
 	uint8_t data_par;
 	if (type == READ_TRANSACTION) {
@@ -72,6 +172,11 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 	clk_low();
 	assert_irdy();
 	deassert_frame_1();
+	/* LOCK# goes on in the clock after the address phase */
+	if (lock_next) {
+		assert_lock();
+		lock_next = 0;
+	}
 
 	par_output_mode();
 	par_set(addr_par);
@@ -79,6 +184,7 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 	/* wait for DEVSEL to be asserted */
 	int c = 4;
 	while (!is_devsel_asserted()) {
+		WAVE_SAMPLE(0);
 		clk_high();
 		if (type == READ_TRANSACTION) {
 			par_tristate();
@@ -89,27 +195,31 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 		c--;
 
 		if (c == 0) {
-			/* TODO: let caller decide if this is fatal (during
-			 * normal operation) or expected (bus enumeration etc.)
-			 */
-			console_fstr("Master Abort/!DEVSEL");
-			_delay_ms(2000);
+			STATS_INC(master_aborts);
+			STATS_ADD(busy_clocks, 2 + 4);
+			transaction_status = MASTER_ABORT;
 			goto master_abort;
 		}
 	}
+	uint8_t devsel_wait = 4 - c;
+	STATS_ADD(devsel_wait, devsel_wait);
 
 	/* wait for TRDY to be asserted */
 	c = 12;
 	while (!is_trdy_asserted()) {
 		if (is_stop_asserted()) {
+			STATS_ADD(trdy_wait, 12 - c);
+			STATS_ADD(busy_clocks, 2 + devsel_wait + 12 - c);
 			if (is_devsel_asserted()) {
 				goto retry;
 			} else {
-				console_fstr("target abort\n");
+				STATS_INC(target_aborts);
+				transaction_status = MASTER_TARGET_ABORT;
 				goto target_abort;
 			}
 		}
 
+		WAVE_SAMPLE(0);
 		clk_high();
 		if (type == READ_TRANSACTION) {
 			par_tristate();
@@ -126,10 +236,16 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 			 * the spec, but it's a good idea to have some kind of
 			 * timeout here...)
 			 */
-			console_fstr("unreal master abort");
+			STATS_INC(master_aborts);
+			STATS_ADD(trdy_wait, 12);
+			STATS_ADD(busy_clocks, 2 + devsel_wait + 12);
+			transaction_status = MASTER_ABORT;
 			goto master_abort;
 		}
 	}
+	STATS_ADD(trdy_wait, 12 - c);
+	/* address, first data clock, waits, data phase, turnaround */
+	STATS_ADD(busy_clocks, 2 + devsel_wait + (12 - c) + 2);
 
 	/* TRDY is asserted and as we have previously asserted IRDY, a data
 	 * phase is about to happen.
@@ -137,9 +253,11 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 	uint32_t adval;
 	if (type == READ_TRANSACTION) {
 		adval = ad_get();
+		WAVE_SAMPLE(0);
 		clk_high();
 		par_tristate();
 	} else {
+		WAVE_SAMPLE(0);
 		clk_high();
 		par_set(data_par);
 		ad_tristate();
@@ -153,20 +271,29 @@ __attribute__((always_inline)) static uint32_t master_transaction(uint32_t addr,
 	 * also, this is one clock after the data phase, so the last cycle for
 	 * parity
 	 */
+	transaction_status = MASTER_OK;
 	if (type == READ_TRANSACTION) {
-		/* target provides parity, we read and verify it */
+		/* target provides parity, we read and verify it. the data is
+		 * returned anyway, the caller decides about trying again.
+		 */
 		uint8_t adval_par = par_get();
 		if (adval_par != ad_cbe_parity(adval, be)) {
-			/* TODO handle properly */
-			panic("Parity error");
+			parity_error();
 		}
 	}
+	WAVE_SAMPLE(0);
 	clk_high();
 	deassert_irdy_2();
 	par_tristate();
 	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
+	PERR_CLOCK();
+	perr_finish();
 
 	sanity_deasserted_devsel_trdy();
+	/* the BAR lookup takes a while, so not before the bus is idle */
+	HIST_RECORD(addr, cmd, devsel_wait, 12 - c);
+	transaction_clocks = 4 + devsel_wait + (12 - c) + !!addr_hi;
 
 	if (type == READ_TRANSACTION) {
 		return adval;
@@ -181,32 +308,662 @@ target_abort:
 	ad_tristate();
 	cbe_tristate();
 	par_tristate();
+	WAVE_SAMPLE(0);
 	clk_high();
 	deassert_irdy_2();
 	deassert_frame_2();
 	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
 
 	sanity_deasserted_devsel_trdy();
+	transaction_clocks = 0; /* not worth counting */
 
 	return 0xffffffff;
 
 retry:
-	/* TODO - currently unimplemented (RTL8139/69 never respond with
-	 * Target Retry)
+	/* nothing happened, master_single() does it again */
+	STATS_INC(retries);
+	transaction_status = MASTER_RETRY;
+
+	/* the transaction ends on the clock where the target sees IRDY#
+	 * together with its STOP#, FRAME# is already deasserted and only has
+	 * to be let go of
+	 */
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_frame_2();
+	clk_low();
+	deassert_irdy_1();
+	ad_tristate();
+	cbe_tristate();
+	par_tristate();
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_irdy_2();
+	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
+
+	sanity_deasserted_devsel_trdy();
+	/* as long as a complete one, polling has to count it against its
+	 * timeout
 	 */
-	panic("Target requested Retry but this is unimplemented");
+	transaction_clocks = 4 + devsel_wait + (12 - c) + !!addr_hi;
+
+	return 0xffffffff;
 }
 
+/* every transaction goes into the flight recorder, and into a trace frame
+ * with TRACE_SUPPORT
+ */
+static void record(uint8_t id, uint32_t addr, uint8_t cmd, uint8_t be, uint32_t data, uint8_t status) {
+	flight_record(addr, cmd, be, data, status);
+	trace_transaction(id, addr, cmd, be, data);
+}
+
+/* a Target Retry means the target did not take anything yet, the same
+ * transaction is simply repeated. during enumeration it means that the
+ * function is not ready yet, which is the caller's business.
+ */
+#define MASTER_RETRIES 16
+
+__attribute__((always_inline)) static uint32_t master_single(uint32_t addr, uint32_t addr_hi, uint8_t cmd, uint8_t be, uint32_t value, enum _rw_type type, uint8_t addr_par) {
+	uint8_t tries = MASTER_RETRIES;
+	uint32_t x;
+	do {
+		x = master_transaction(addr, addr_hi, cmd, be, value, type, addr_par);
+	} while (transaction_status == MASTER_RETRY && !abort_expected && --tries);
+	return x;
+}
+
+
+/* burst transaction, one data phase per dword with the same byte enables
+ * for all of them. the target may disconnect at any time (with or without
+ * data), so this returns how many dwords actually were transferred and the
+ * caller goes on with a new transaction. a Master Abort transfers nothing,
+ * a Target Abort ends it after the data phases that went through.
+ * FRAME# stays asserted until the last data phase, PAR always lags AD by
+ * one clock.
+ */
+static uint8_t master_burst(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t *data, uint8_t n, enum _rw_type type) {
+	sanity_deasserted_frame_irdy();
+	transaction_status = MASTER_OK;
+
+	STATS_INC(by_cmd[cmd & 0xf]);
+
+	/* Address phase */
+
+	WAVE_SAMPLE(WAVE_START);
+	clk_high();
+	clk_low();
+	assert_frame();
+
+	ad_output_mode();
+	ad_set(addr);
+	cbe_output_mode();
+	cbe_set(cmd);
+	uint8_t par = ad_cbe_parity(addr, cmd);
+
+	WAVE_SAMPLE(0);
+	clk_high();
+	if (type == READ_TRANSACTION) {
+		ad_tristate();
+	} else {
+		ad_set(data[0]);
+	}
+	cbe_set(be);
+
+	clk_low();
+	assert_irdy();
+	if (n == 1) {
+		deassert_frame_1();
+	}
+	par_output_mode();
+	par_set(par);
+	if (type == WRITE_TRANSACTION) {
+		par = ad_cbe_parity(data[0], be);
+	}
+
+	/* wait for DEVSEL to be asserted */
+	uint8_t c = 4;
+	uint8_t busy = 2;
+	uint8_t i = 0;
+	while (!is_devsel_asserted()) {
+		WAVE_SAMPLE(0);
+		clk_high();
+		if (type == READ_TRANSACTION) {
+			par_tristate();
+		} else {
+			par_set(par);
+		}
+		clk_low();
+		c--;
+
+		if (c == 0) {
+			STATS_INC(master_aborts);
+			STATS_ADD(busy_clocks, 2 + 4);
+			transaction_status = MASTER_ABORT;
+			goto master_abort;
+		}
+	}
+	uint8_t devsel_wait = 4 - c;
+	STATS_ADD(devsel_wait, devsel_wait);
+	busy += devsel_wait;
+
+	uint8_t stop;
+	uint8_t trdy_wait = 0; /* of the first data phase */
+	for (;;) {
+		/* wait for TRDY to be asserted */
+		c = 12;
+		while (!is_trdy_asserted()) {
+			if (is_stop_asserted()) {
+				STATS_ADD(trdy_wait, 12 - c);
+				busy += 12 - c;
+				if (!is_devsel_asserted()) {
+					/* the data phases before went through */
+					STATS_INC(target_aborts);
+					STATS_ADD(busy_clocks, busy);
+					transaction_status = MASTER_TARGET_ABORT;
+					goto target_abort;
+				}
+				/* disconnect without data, or a retry if
+				 * nothing has been transferred at all yet
+				 */
+				goto disconnect;
+			}
+
+			WAVE_SAMPLE(0);
+			clk_high();
+			if (type == READ_TRANSACTION) {
+				par_tristate();
+			} else {
+				par_set(par);
+			}
+			clk_low();
+			PERR_CLOCK();
+			c--;
+
+			if (c == 0) {
+				STATS_INC(master_aborts);
+				STATS_ADD(trdy_wait, 12);
+				STATS_ADD(busy_clocks, busy + 12);
+				transaction_status = MASTER_ABORT;
+				goto master_abort;
+			}
+		}
+		STATS_ADD(trdy_wait, 12 - c);
+		busy += 12 - c + 1;
+		if (i == 0) {
+			trdy_wait = 12 - c;
+		}
+
+		/* data phase i happens on this edge. STOP# along with TRDY#
+		 * means it is the last one the target takes.
+		 */
+		stop = is_stop_asserted();
+		if (type == READ_TRANSACTION) {
+			data[i] = ad_get();
+		}
+		WAVE_SAMPLE(0);
+		clk_high();
+		if (type == READ_TRANSACTION) {
+			par_tristate();
+		} else {
+			par_set(par);
+		}
+		i++;
+		if (i == n) {
+			break;
+		}
+		if (type == WRITE_TRANSACTION) {
+			ad_set(data[i]);
+			par = ad_cbe_parity(data[i], be);
+		}
+		clk_low();
+		PERR_CLOCK();
+
+		if (type == READ_TRANSACTION && par_get() != ad_cbe_parity(data[i - 1], be)) {
+			parity_error();
+		}
+
+		if (stop) {
+			goto disconnect;
+		}
+		if (i == n - 1) {
+			deassert_frame_1();
+		}
+	}
+
+	/* regular end, FRAME# has been deasserted before the last data phase */
+	deassert_irdy_1();
+	deassert_frame_2();
+	cbe_tristate();
+	if (type == WRITE_TRANSACTION) {
+		ad_tristate();
+	}
+	clk_low();
+	PERR_CLOCK();
+
+	if (type == READ_TRANSACTION && par_get() != ad_cbe_parity(data[n - 1], be)) {
+		parity_error();
+	}
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_irdy_2();
+	par_tristate();
+	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
+	PERR_CLOCK();
+	perr_finish();
+	STATS_ADD(busy_clocks, busy + 1);
+
+	sanity_deasserted_devsel_trdy();
+	HIST_RECORD(addr, cmd, devsel_wait, trdy_wait);
+	return n;
+
+disconnect:
+	/* the transaction ends on the first clock with FRAME# deasserted and
+	 * IRDY#, STOP# asserted
+	 */
+	if (i == 0) {
+		STATS_INC(retries);
+		transaction_status = MASTER_RETRY;
+	} else {
+		STATS_INC(disconnects);
+	}
+	if (is_frame_asserted()) {
+		deassert_frame_1();
+	}
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_frame_2();
+	if (type == WRITE_TRANSACTION) {
+		par_set(par);
+	} else {
+		par_tristate();
+	}
+	clk_low();
+	PERR_CLOCK();
+	deassert_irdy_1();
+	ad_tristate();
+	cbe_tristate();
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_irdy_2();
+	par_tristate();
+	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
+	PERR_CLOCK();
+	perr_finish();
+	STATS_ADD(busy_clocks, busy + 2);
+
+	sanity_deasserted_devsel_trdy();
+	if (i) {
+		HIST_RECORD(addr, cmd, devsel_wait, trdy_wait);
+	}
+	return i;
+
+master_abort:
+	i = 0;
+target_abort:
+	/* IRDY# has to stay asserted for the clock FRAME# goes away on */
+	if (is_frame_asserted()) {
+		deassert_frame_1();
+		WAVE_SAMPLE(0);
+		clk_high();
+		deassert_frame_2();
+		clk_low();
+		PERR_CLOCK();
+	}
+	deassert_irdy_1();
+	ad_tristate();
+	cbe_tristate();
+	par_tristate();
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_irdy_2();
+	deassert_frame_2();
+	clk_low();
+	PERR_CLOCK();
+	WAVE_SAMPLE(0); /* bus idle again */
+	perr_finish();
+
+	sanity_deasserted_devsel_trdy();
+	return i;
+}
 
 uint32_t master_read(uint32_t addr, uint8_t cmd, uint8_t be) {
+	arbiter_acquire();
 	clk_stop();
-	uint32_t x = master_transaction(addr, cmd, be, 0, READ_TRANSACTION);
+	uint32_t x = master_single(addr, 0, cmd, be, 0, READ_TRANSACTION, ad_cbe_parity(addr, cmd));
 	clk_start();
+	arbiter_release();
+	record(TRACE_MASTER_READ, addr, cmd, be, x, transaction_status);
 	return x;
 }
 
+/* addresses above 4G. the high dword being 0 is the common case, that
+ * goes the usual single address way.
+ */
+uint32_t master_read64(uint64_t addr, uint8_t cmd, uint8_t be) {
+	uint32_t lo = addr, hi = addr >> 32;
+	if (!hi) {
+		return master_read(lo, cmd, be);
+	}
+	arbiter_acquire();
+	clk_stop();
+	uint32_t x = master_single(lo, hi, cmd, be, 0, READ_TRANSACTION, 0);
+	clk_start();
+	arbiter_release();
+	/* only the low dword fits into the frame */
+	record(TRACE_MASTER_READ, lo, cmd, be, x, transaction_status);
+	return x;
+}
+
+void master_write64(uint64_t addr, uint8_t cmd, uint8_t be, uint32_t value) {
+	uint32_t lo = addr, hi = addr >> 32;
+	if (!hi) {
+		master_write(lo, cmd, be, value);
+		return;
+	}
+	arbiter_acquire();
+	clk_stop();
+	master_single(lo, hi, cmd, be, value, WRITE_TRANSACTION, 0);
+	clk_start();
+	arbiter_release();
+	record(TRACE_MASTER_WRITE, lo, cmd, be, value, transaction_status);
+}
+
 void master_write(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t value) {
+	arbiter_acquire();
+	clk_stop();
+	master_single(addr, 0, cmd, be, value, WRITE_TRANSACTION, ad_cbe_parity(addr, cmd));
+	clk_start();
+	arbiter_release();
+	record(TRACE_MASTER_WRITE, addr, cmd, be, value, transaction_status);
+}
+
+/* read the same register over and over until (value & mask) == match or
+ * timeout_clocks PCI clocks have passed, whichever comes first. the clock
+ * is bit-banged for the whole time, and the address phase is the same for
+ * every read, so its parity is only computed once. a Master or Target
+ * Abort ends the poll right away, Retries and parity errors just make it
+ * poll again, whatever they returned.
+ * returns the last value read, only that one gets traced. it is only
+ * worth anything if master_status() is MASTER_OK afterwards.
+ */
+uint32_t master_poll(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks) {
+	uint8_t addr_par = ad_cbe_parity(addr, cmd);
+	uint32_t elapsed = 0;
+	uint32_t x;
+
+	arbiter_acquire();
 	clk_stop();
-	master_transaction(addr, cmd, be, value, WRITE_TRANSACTION);
+	do {
+		x = master_transaction(addr, 0, cmd, be, 0, READ_TRANSACTION, addr_par);
+		elapsed += transaction_clocks;
+	} while (!(transaction_status == MASTER_OK && (x & mask) == match)
+		&& transaction_status != MASTER_ABORT && transaction_status != MASTER_TARGET_ABORT
+		&& elapsed < timeout_clocks);
 	clk_start();
+	arbiter_release();
+
+	record(TRACE_MASTER_READ, addr, cmd, be, x, transaction_status);
+	if (clocks) {
+		*clocks = elapsed;
+	}
+	return x;
+}
+
+/* read, then write back (value & ~clear) | set right away, all in one go
+ * with the clock stopped. be selects the bytes that are looked at, the
+ * write is left out if none of them would change.
+ * with lock, LOCK# is held from the read until after the write, so that
+ * no other master gets to the target in between (memory space only).
+ * nothing is written if the read did not go through cleanly, not even
+ * after a Retry (see master_status()).
+ * returns the old value.
+ */
+uint32_t master_modify(uint32_t addr, uint8_t rcmd, uint8_t wcmd, uint8_t be, uint32_t clear, uint32_t set, uint8_t lock) {
+	uint32_t lanes = 0;
+	for (uint8_t i = 0; i < 4; i++) {
+		if (!(be & (1 << i))) {
+			lanes |= 0xffUL << (8 * i);
+		}
+	}
+
+	arbiter_acquire();
+	clk_stop();
+	lock_next = lock;
+	uint32_t old = master_transaction(addr, 0, rcmd, be, 0, READ_TRANSACTION, ad_cbe_parity(addr, rcmd));
+	uint8_t rstatus = transaction_status;
+	uint32_t new = (old & ~clear) | set;
+	uint8_t write = rstatus == MASTER_OK && ((old ^ new) & lanes);
+	if (write) {
+		master_transaction(addr, 0, wcmd, be, new, WRITE_TRANSACTION, ad_cbe_parity(addr, wcmd));
+	}
+	if (lock) {
+		lock_next = 0;
+		deassert_lock_1();
+		clk_high();
+		clk_low();
+		deassert_lock_2();
+	}
+	clk_start();
+	arbiter_release();
+
+	record(TRACE_MASTER_READ, addr, rcmd, be, old, rstatus);
+	if (write) {
+		record(TRACE_MASTER_WRITE, addr, wcmd, be, new, transaction_status);
+	}
+	return old;
+}
+
+/* fast back-to-back writes to one target: the address phase of the next
+ * write directly follows the last data phase of the one before, without
+ * an idle clock in between. IRDY# is driven high in that clock, PAR still
+ * belongs to the previous data phase.
+ * the caller has to make sure the target can do this
+ * (PCIM_STATUS_BACKTOBACK). any kind of termination other than a regular
+ * data phase ends the sequence. at most B2B_MAX writes are done in one go,
+ * returns the number of writes done.
+ */
+uint8_t master_write_b2b(const struct pci_write *w, uint8_t n, uint8_t cmd) {
+	uint8_t done = 0;
+	uint8_t addr_par;
+	uint8_t data_par = 0;
+	uint8_t c;
+#ifdef PCI_HIST
+	/* DEVSEL# and TRDY# waits of every write, recorded afterwards */
+	uint8_t waits[B2B_MAX];
+#endif
+
+	transaction_status = MASTER_OK;
+	if (n == 0) {
+		return 0;
+	}
+	if (n > B2B_MAX) {
+		n = B2B_MAX;
+	}
+
+	arbiter_acquire();
+	clk_stop();
+	sanity_deasserted_frame_irdy();
+
+	WAVE_SAMPLE(WAVE_START);
+	clk_high();
+	clk_low();
+	assert_frame();
+	ad_output_mode();
+	ad_set(w[0].addr);
+	cbe_output_mode();
+	cbe_set(cmd);
+
+	for (uint8_t i = 0; i < n; i++) {
+		STATS_INC(by_cmd[cmd & 0xf]);
+		addr_par = ad_cbe_parity(w[i].addr, cmd);
+
+		/* Address phase */
+
+		WAVE_SAMPLE(0);
+		clk_high();
+		ad_set(w[i].value);
+		cbe_set(w[i].be);
+		data_par = ad_cbe_parity(w[i].value, w[i].be);
+		clk_low();
+		assert_irdy();
+		deassert_frame_1();
+		par_output_mode();
+		par_set(addr_par);
+
+		c = 4;
+		while (!is_devsel_asserted()) {
+			WAVE_SAMPLE(0);
+			clk_high();
+			par_set(data_par);
+			clk_low();
+			if (--c == 0) {
+				STATS_INC(master_aborts);
+				transaction_status = MASTER_ABORT;
+				goto master_abort;
+			}
+		}
+		uint8_t devsel_wait = 4 - c;
+		STATS_ADD(devsel_wait, devsel_wait);
+
+		c = 12;
+		while (!is_trdy_asserted()) {
+			if (is_stop_asserted()) {
+				if (is_devsel_asserted()) {
+					STATS_INC(retries);
+					transaction_status = MASTER_RETRY;
+				} else {
+					STATS_INC(target_aborts);
+					transaction_status = MASTER_TARGET_ABORT;
+				}
+				goto stop;
+			}
+			WAVE_SAMPLE(0);
+			clk_high();
+			par_set(data_par);
+			clk_low();
+			if (--c == 0) {
+				STATS_INC(master_aborts);
+				transaction_status = MASTER_ABORT;
+				goto master_abort;
+			}
+		}
+		STATS_ADD(trdy_wait, 12 - c);
+		STATS_ADD(busy_clocks, 2 + devsel_wait + (12 - c));
+#ifdef PCI_HIST
+		waits[i] = devsel_wait << 4 | (12 - c);
+#endif
+
+		/* data phase */
+		WAVE_SAMPLE(0);
+		clk_high();
+		par_set(data_par);
+		done++;
+		if (i + 1 == n) {
+			break;
+		}
+
+		/* next address phase right away */
+		deassert_irdy_1();
+		assert_frame();
+		ad_set(w[i + 1].addr);
+		cbe_set(cmd);
+		clk_low();
+	}
+
+	/* the last one ends like a single write */
+	deassert_irdy_1();
+	deassert_frame_2();
+	cbe_tristate();
+	ad_tristate();
+	clk_low();
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_irdy_2();
+	par_tristate();
+	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
+	STATS_ADD(busy_clocks, 1);
+	goto out;
+
+stop:
+	/* retry, disconnect or target abort: STOP# together with IRDY# ends
+	 * it on the next clock. FRAME# is deasserted already.
+	 */
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_frame_2();
+	par_set(data_par);
+	clk_low();
+	deassert_irdy_1();
+	ad_tristate();
+	cbe_tristate();
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_irdy_2();
+	par_tristate();
+	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
+	goto out;
+
+master_abort:
+	deassert_irdy_1();
+	ad_tristate();
+	cbe_tristate();
+	par_tristate();
+	WAVE_SAMPLE(0);
+	clk_high();
+	deassert_irdy_2();
+	deassert_frame_2();
+	clk_low();
+	WAVE_SAMPLE(0); /* bus idle again */
+
+out:
+	sanity_deasserted_devsel_trdy();
+	clk_start();
+	arbiter_release();
+
+	for (uint8_t i = 0; i < done; i++) {
+#ifdef PCI_HIST
+		HIST_RECORD(w[i].addr, cmd, waits[i] >> 4, waits[i] & 0xf);
+#endif
+		record(TRACE_MASTER_WRITE, w[i].addr, cmd, w[i].be, w[i].value, MASTER_OK);
+	}
+	if (done < n) {
+		flight_record(w[done].addr, cmd, w[done].be, w[done].value, transaction_status);
+	}
+	return done;
+}
+
+/* bursts stop the clock only once for the whole transaction, and only get
+ * one flight recorder entry, so that they do not push everything else out
+ */
+uint8_t master_read_burst(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t *data, uint8_t n) {
+	arbiter_acquire();
+	clk_stop();
+	uint8_t done = master_burst(addr, cmd, be, data, n, READ_TRANSACTION);
+	clk_start();
+	arbiter_release();
+	flight_record(addr, cmd, be, done ? data[0] : 0, transaction_status);
+	for (uint8_t i = 0; i < done; i++) {
+		trace_transaction(TRACE_MASTER_READ, addr + 4 * i, cmd, be, data[i]);
+	}
+	return done;
+}
+
+uint8_t master_write_burst(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t *data, uint8_t n) {
+	arbiter_acquire();
+	clk_stop();
+	uint8_t done = master_burst(addr, cmd, be, data, n, WRITE_TRANSACTION);
+	clk_start();
+	arbiter_release();
+	flight_record(addr, cmd, be, data[0], transaction_status);
+	for (uint8_t i = 0; i < done; i++) {
+		trace_transaction(TRACE_MASTER_WRITE, addr + 4 * i, cmd, be, data[i]);
+	}
+	return done;
 }
@@ -3,8 +3,37 @@
 
 #include <stdint.h>
 
+/* longest fast back-to-back sequence without an idle clock */
+#define B2B_MAX 16
+
+/* one write of a fast back-to-back sequence */
+struct pci_write {
+	uint32_t addr;
+	uint8_t be;
+	uint32_t value;
+};
+
+/* how the last transaction ended */
+enum master_status {
+	MASTER_OK,
+	MASTER_ABORT,        /* nobody claimed it, or TRDY# never came */
+	MASTER_TARGET_ABORT,
+	MASTER_RETRY,        /* still Retry after trying again a few times */
+	MASTER_PARITY,       /* data parity error on a read, PERR# was asserted */
+};
+
 uint32_t master_read(uint32_t addr, uint8_t cmd, uint8_t be);
 void master_write(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t value);
+uint32_t master_read64(uint64_t addr, uint8_t cmd, uint8_t be);
+void master_write64(uint64_t addr, uint8_t cmd, uint8_t be, uint32_t value);
+uint32_t master_poll(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks);
+uint32_t master_modify(uint32_t addr, uint8_t rcmd, uint8_t wcmd, uint8_t be, uint32_t clear, uint32_t set, uint8_t lock);
+uint8_t master_write_b2b(const struct pci_write *w, uint8_t n, uint8_t cmd);
+uint8_t master_read_burst(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t *data, uint8_t n);
+uint8_t master_write_burst(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t *data, uint8_t n);
+void master_expect_abort(uint8_t expected);
+uint8_t master_status();
+void master_reset();
 
 #endif
 
@@ -0,0 +1,126 @@
+#include <avr/io.h>
+#include <stdint.h>
+#include "console.h"
+#include "trace.h"
+#include "pci/arbiter.h"
+#include "pci/monitor.h"
+#include "pci/pins.h"
+#include "pci/signals.h"
+#include "pci/wave.h"
+
+/* passive bus monitor.
+ * we only generate the clock and look at what everyone else is doing. the
+ * phases are decoded on the fly and go into a ring buffer, the oldest
+ * records get overwritten.
+ * the external memory interface would need ports A, C and G, which are
+ * all taken by the bus, so the buffer has to live in internal RAM.
+ */
+
+static struct mon_record records[MONITOR_RECORDS];
+static uint8_t mon_head = 0;
+static uint8_t mon_count = 0;
+
+static struct mon_record *new_record(uint16_t clock, uint8_t kind, uint8_t cbe, uint32_t ad) {
+	struct mon_record *r = &records[mon_head];
+	r->clock = clock;
+	r->kind = kind;
+	r->cbe_par = cbe;
+	r->ad = ad;
+
+	mon_head = (mon_head + 1) % MONITOR_RECORDS;
+	if (mon_count < MONITOR_RECORDS) {
+		mon_count++;
+	}
+	return r;
+}
+
+/* run the bus for the given number of clocks without driving anything but
+ * CLK (and GNT#, if the card should be allowed to become a master, the
+ * arbiter stays out of it meanwhile).
+ * returns the number of records in the buffer.
+ */
+uint8_t monitor_capture(uint32_t clocks, uint8_t grant) {
+	mon_head = 0;
+	mon_count = 0;
+
+	arbiter_acquire();
+	clk_stop();
+	ad_tristate();
+	cbe_tristate();
+	par_tristate();
+	if (grant) {
+		gnt_assert();
+	}
+
+	uint8_t prev_ctl = 0xff;
+	struct mon_record *last = 0;
+
+	for (uint32_t clock = 0; clock < clocks; clock++) {
+		/* everything is sampled before the rising edge, like a PCI
+		 * device would
+		 */
+		uint8_t ctl = PINF;
+		uint32_t ad = ad_get();
+		uint8_t cbe = PINA & 0x0f;
+		uint8_t par = PINK & PK_PAR;
+		WAVE_SAMPLE(clock ? 0 : WAVE_START);
+		clk_high();
+		clk_low();
+
+		/* PAR belongs to the phase one clock earlier */
+		if (last) {
+			if (par) {
+				last->cbe_par |= MON_PAR;
+			}
+			last = 0;
+		}
+
+		/* FRAME# only ever gets asserted for an address phase */
+		if (!(ctl & PF_FRAME) && (prev_ctl & PF_FRAME)) {
+			last = new_record(clock, MON_ADDR, cbe, ad);
+		} else if (!(ctl & PF_IRDY) && !(ctl & PF_TRDY)) {
+			last = new_record(clock, MON_DATA, cbe, ad);
+		}
+
+		if (!(ctl & PF_STOP) && (prev_ctl & PF_STOP)) {
+			new_record(clock, MON_STOP, 0, ctl);
+		}
+
+		prev_ctl = ctl;
+	}
+
+	clk_start();
+	if (grant) {
+		gnt_deassert();
+		arbiter_wait_idle();
+	}
+	arbiter_release();
+
+	return mon_count;
+}
+
+uint8_t monitor_count() {
+	return mon_count;
+}
+
+/* i = 0 is the oldest record */
+const struct mon_record *monitor_record(uint8_t i) {
+	uint8_t first = (mon_head + MONITOR_RECORDS - mon_count) % MONITOR_RECORDS;
+	return &records[(first + i) % MONITOR_RECORDS];
+}
+
+void monitor_dump() {
+	for (uint8_t i = 0; i < mon_count; i++) {
+		const struct mon_record *r = monitor_record(i);
+#ifdef TRACE_SUPPORT
+		trace_event(TRACE_MONITOR, r, sizeof(*r));
+#else
+		console_hex16(r->clock);
+		console_char("ADS"[r->kind]);
+		console_hex8(r->cbe_par);
+		console_char(' ');
+		console_hex32(r->ad);
+		console_char('\n');
+#endif
+	}
+}
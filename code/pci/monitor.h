@@ -0,0 +1,28 @@
+#ifndef PCI_MONITOR_H
+#define PCI_MONITOR_H
+
+#include <stdint.h>
+
+enum mon_kind {
+	MON_ADDR, /* address phase, cbe is the command */
+	MON_DATA, /* data phase, cbe are the byte enables */
+	MON_STOP, /* STOP# asserted, ad holds the control lines */
+};
+
+#define MON_PAR (1 << 4) /* in cbe_par: PAR one clock after the phase */
+
+struct mon_record {
+	uint16_t clock;  /* clock number since capture start */
+	uint8_t kind;
+	uint8_t cbe_par;
+	uint32_t ad;
+};
+
+#define MONITOR_RECORDS 128
+
+uint8_t monitor_capture(uint32_t clocks, uint8_t grant);
+uint8_t monitor_count();
+const struct mon_record *monitor_record(uint8_t i);
+void monitor_dump();
+
+#endif
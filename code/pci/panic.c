@@ -1,17 +1,36 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "console.h"
+#include "pci/flight.h"
 #include "pci/signals.h"
 #include "pci/panic.h"
 
-void panic(const char *m) {
+__attribute__((noreturn)) static void stop(const char *m, uint8_t save) {
 	disconnect_bus();
 	/* pin change interrupt for PERR and SERR.
 	 * as we stop driving them, we might get irrelevant interrupts.
 	 * TODO: unsure where this should actually be handled
 	 */
 	cli();
+	/* the EEPROM takes its time, so the card is safely in reset first.
+	 * nothing adds to the flight recorder in the meantime.
+	 */
+	if (save) {
+		flight_save(m);
+	}
 	console_str(m);
+	console_flush();
 	while (1) { }
 }
 
+void panic(const char *m) {
+	stop(m, 1);
+}
+
+/* the same for a regular end, which the next boot does not need to hear
+ * about (and the EEPROM does not need to be written for)
+ */
+void halt(const char *m) {
+	stop(m, 0);
+}
+
@@ -2,5 +2,6 @@
 #define PCI_PANIC_H
 
 __attribute__((noreturn)) void panic(const char *m);
+__attribute__((noreturn)) void halt(const char *m);
 
 #endif
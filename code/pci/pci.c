@@ -5,6 +5,8 @@
 #include "master_transaction.h"
 #include "pci.h"
 #include "pci/commands.h"
+#include "pci/device.h"
+#include "pci/registers.h"
 #include "pci/signals.h"
 #include "pci/panic.h"
 
@@ -18,6 +20,58 @@ static void _not_32_aligned() {
 	panic("memory address not 32 bit aligned");
 }
 
+/* Errors
+ * the first one since the last pci_take_error() is kept, so that a driver
+ * can do a whole sequence of accesses and look once at the end.
+ */
+
+static uint8_t first_error = MASTER_OK;
+
+static void note_status() {
+	uint8_t status = master_status();
+	if (status != MASTER_OK && first_error == MASTER_OK) {
+		first_error = status;
+	}
+}
+
+uint8_t pci_take_error() {
+	uint8_t e = first_error;
+	first_error = MASTER_OK;
+	return e;
+}
+
+static uint8_t prefetchable(uint32_t addr) {
+	const struct pci_dev *dev;
+	uint8_t bar = pci_bar_lookup(addr, 0, &dev);
+	return bar != PCI_NO_BAR && (dev->bar_size[bar] & PCIM_BAR_MEM_PREFETCH);
+}
+
+/* reads that can be done again without the target noticing: config
+ * space, and memory behind a prefetchable BAR. only looked at after a
+ * parity error, pci_bar_lookup() is not for every read.
+ */
+static uint8_t read_idempotent(uint32_t addr, uint8_t cmd) {
+	return cmd == CMD_CONFIG_READ || (cmd == CMD_MEM_READ && prefetchable(addr));
+}
+
+#define PARITY_RETRIES 3
+
+static uint32_t pci_read(uint32_t addr, uint8_t cmd, uint8_t be) {
+	uint32_t x = master_read(addr, cmd, be);
+	if (master_status() == MASTER_PARITY && read_idempotent(addr, cmd)) {
+		for (uint8_t i = 0; i < PARITY_RETRIES && master_status() == MASTER_PARITY; i++) {
+			x = master_read(addr, cmd, be);
+		}
+	}
+	note_status();
+	return x;
+}
+
+static void pci_write(uint32_t addr, uint8_t cmd, uint8_t be, uint32_t val) {
+	master_write(addr, cmd, be, val);
+	note_status();
+}
+
 static uint8_t pci_read8(uint32_t addr, uint8_t cmd) {
 	uint8_t mask;
 	uint8_t shift;
@@ -29,21 +83,21 @@ static uint8_t pci_read8(uint32_t addr, uint8_t cmd) {
 	case 0b11: mask = 0b0111; shift = 24; break;
 	}
 
-	return (master_read(addr & ~0b11, cmd, mask) >> shift) & 0xff;
+	return (pci_read(addr & ~0b11, cmd, mask) >> shift) & 0xff;
 }
 
 static uint16_t pci_read16(uint32_t addr, uint8_t cmd) {
 	if ((addr & 0b11) == 0b00) {
-		return master_read(addr, cmd, 0b1100);
+		return pci_read(addr, cmd, 0b1100);
 	} else if ((addr & 0b11) == 0b10) {
-		return (master_read(addr & ~0b11, cmd, 0b0011) >> 16) & 0xffff;
+		return (pci_read(addr & ~0b11, cmd, 0b0011) >> 16) & 0xffff;
 	} else {
 		_unimplemented();
 	}
 }
 
 static uint32_t pci_read32(uint32_t addr, uint8_t cmd) {
-	return master_read(addr, cmd, 0b0000);
+	return pci_read(addr, cmd, 0b0000);
 }
 
 static void pci_write8(uint32_t addr, uint8_t val, uint8_t cmd) {
@@ -57,39 +111,60 @@ static void pci_write8(uint32_t addr, uint8_t val, uint8_t cmd) {
 	case 0b11: mask = 0b0111; shift = 24; break;
 	}
 
-	master_write(addr & ~0b11, cmd, mask, (uint32_t)val << shift);
+	pci_write(addr & ~0b11, cmd, mask, (uint32_t)val << shift);
 }
 
 static void pci_write16(uint32_t addr, uint16_t val, uint8_t cmd) {
 	if ((addr & 0b11) == 0b00) {
-		master_write(addr, cmd, 0b1100, val);
+		pci_write(addr, cmd, 0b1100, val);
 	} else if ((addr & 0b11) == 0b10) {
-		master_write(addr & ~0b11, cmd, 0b0011, (uint32_t)val << 16);
+		pci_write(addr & ~0b11, cmd, 0b0011, (uint32_t)val << 16);
 	} else {
 		_unimplemented();
 	}
 }
 
 static void pci_write32(uint32_t addr, uint32_t val, uint8_t cmd) {
-	master_write(addr, cmd, 0b0000, val);
+	pci_write(addr, cmd, 0b0000, val);
+}
+
+/* Configuration transactions
+ * there is only one slot and IDSEL is always high, so all that is left to
+ * select is the function number (AD[10:8] of a type 0 configuration access)
+ */
+
+static uint8_t config_function = 0;
+
+void pci_select_function(uint8_t fn) {
+	config_function = fn & 0b111;
 }
 
-/* Configuration transactions */
+static uint32_t config_addr(uint8_t addr) {
+	return ((uint32_t)config_function << 8) | addr;
+}
+
+uint8_t pci_config_read8(uint8_t addr) {
+	return pci_read8(config_addr(addr), CMD_CONFIG_READ);
+}
+
+uint16_t pci_config_read16(uint8_t addr) {
+	return pci_read16(config_addr(addr), CMD_CONFIG_READ);
+}
 
 uint32_t pci_config_read32(uint8_t addr) {
-	return pci_read32(addr, CMD_CONFIG_READ);
+	return pci_read32(config_addr(addr), CMD_CONFIG_READ);
 }
 
 void pci_config_write8(uint8_t addr, uint8_t val) {
-	pci_write8(addr, val, CMD_CONFIG_WRITE);
+	pci_write8(config_addr(addr), val, CMD_CONFIG_WRITE);
 }
 
 void pci_config_write16(uint8_t addr, uint16_t val) {
-	pci_write16(addr, val, CMD_CONFIG_WRITE);
+	pci_write16(config_addr(addr), val, CMD_CONFIG_WRITE);
 }
 
 void pci_config_write32(uint8_t addr, uint32_t val) {
-	pci_write32(addr, val, CMD_CONFIG_WRITE);
+	pci_write32(config_addr(addr), val, CMD_CONFIG_WRITE);
 }
 
 /* I/O Access */
@@ -143,3 +218,227 @@ void pci_mem_write16(uint32_t addr, uint16_t val) {
 void pci_mem_write32(uint32_t addr, uint32_t val) {
 	pci_write32(addr, val, CMD_MEM_WRITE);
 }
+
+/* Mem Access above 4G (Dual Address Cycle) */
+
+uint32_t pci_mem64_read32(uint64_t addr) {
+	if (addr & 0b11) {
+		_not_32_aligned();
+	}
+	uint32_t x = master_read64(addr, CMD_MEM_READ, 0b0000);
+	note_status();
+	return x;
+}
+
+void pci_mem64_write32(uint64_t addr, uint32_t val) {
+	if (addr & 0b11) {
+		_not_32_aligned();
+	}
+	master_write64(addr, CMD_MEM_WRITE, 0b0000, val);
+	note_status();
+}
+
+/* Burst access
+ * the target may disconnect in the middle of a burst, the rest then goes
+ * into a new transaction. returns the number of dwords transferred, which
+ * is less than n after a Master Abort or too many retries in a row.
+ * a chunk that was read with a parity error is read again if it can be.
+ */
+
+#define BURST_RETRIES 16
+#define BURST_MAX ((255 / PCI_CACHE_LINE) * PCI_CACHE_LINE)
+
+/* prefetchable memory gets the commands that let the target stream:
+ * Memory Read Line for more than half a cache line up to three lines,
+ * Memory Read Multiple above that. whole, aligned cache lines are written
+ * with Memory Write and Invalidate.
+ */
+static uint8_t burst_cmd(uint32_t addr, uint8_t n, uint8_t cmd) {
+	if (!prefetchable(addr)) {
+		return cmd;
+	}
+
+	if (cmd == CMD_MEM_WRITE) {
+		if (!((addr / 4) % PCI_CACHE_LINE) && !(n % PCI_CACHE_LINE)) {
+			return CMD_MEM_WRITE_INV;
+		}
+	} else if (n > 3 * PCI_CACHE_LINE) {
+		return CMD_MEM_READ_MULT;
+	} else if (n > PCI_CACHE_LINE / 2) {
+		return CMD_MEM_READ_LINE;
+	}
+	return cmd;
+}
+
+static uint16_t pci_burst(uint32_t addr, uint32_t *data, uint16_t n, uint8_t cmd, uint8_t write) {
+	if (addr & 0b11) {
+		_not_32_aligned();
+	}
+
+	uint16_t done = 0;
+	uint8_t retries = 0;
+	uint8_t parity_retries = 0;
+	while (done < n) {
+		/* whole cache lines, so that MWI does not stop half way */
+		uint8_t chunk = (n - done > BURST_MAX) ? BURST_MAX : n - done;
+		uint8_t got;
+		if (write) {
+			got = master_write_burst(addr + 4 * done, burst_cmd(addr + 4 * done, chunk, cmd), 0b0000, data + done, chunk);
+		} else {
+			got = master_read_burst(addr + 4 * done, burst_cmd(addr + 4 * done, chunk, cmd), 0b0000, data + done, chunk);
+		}
+		if (!write && master_status() == MASTER_PARITY && parity_retries < PARITY_RETRIES
+			&& read_idempotent(addr + 4 * done, CMD_MEM_READ)) {
+			parity_retries++;
+			continue;
+		}
+		uint8_t status = master_status();
+		if (status != MASTER_RETRY) {
+			note_status();
+		}
+		/* a Target Abort may come after some data phases */
+		done += got;
+		if (status == MASTER_ABORT || status == MASTER_TARGET_ABORT) {
+			break;
+		}
+		if (got) {
+			retries = 0;
+		} else if (++retries == BURST_RETRIES) {
+			note_status();
+			break;
+		}
+	}
+	return done;
+}
+
+uint16_t pci_mem_read_burst(uint32_t addr, uint32_t *data, uint16_t n) {
+	return pci_burst(addr, data, n, CMD_MEM_READ, 0);
+}
+
+uint16_t pci_mem_write_burst(uint32_t addr, uint32_t *data, uint16_t n) {
+	return pci_burst(addr, data, n, CMD_MEM_WRITE, 1);
+}
+
+/* Polling
+ * addr may point to a byte or word register inside of a dword, mask and
+ * match are relative to it. only the byte lanes covered by mask are read,
+ * so reading does not touch neighbouring registers.
+ * returns the last value read, which only matches if there was no timeout.
+ * after an abort it is all ones, check master_status() before trusting it.
+ */
+
+static uint32_t pci_poll_until(uint32_t addr, uint8_t cmd, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks) {
+	uint8_t shift = 8 * (addr & 0b11);
+	uint32_t m = mask << shift;
+	uint8_t be = 0;
+	for (uint8_t lane = 0; lane < 4; lane++) {
+		if (!((m >> (8 * lane)) & 0xff)) {
+			be |= 1 << lane;
+		}
+	}
+	uint32_t x = master_poll(addr & ~0b11, cmd, be, m, match << shift, timeout_clocks, clocks);
+	note_status();
+	return x >> shift;
+}
+
+uint32_t pci_config_poll_until(uint8_t addr, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks) {
+	return pci_poll_until(config_addr(addr), CMD_CONFIG_READ, mask, match, timeout_clocks, clocks);
+}
+
+uint32_t pci_io_poll_until(uint32_t addr, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks) {
+	return pci_poll_until(addr, CMD_IO_READ, mask, match, timeout_clocks, clocks);
+}
+
+uint32_t pci_mem_poll_until(uint32_t addr, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks) {
+	return pci_poll_until(addr, CMD_MEM_READ, mask, match, timeout_clocks, clocks);
+}
+
+/* Read-modify-write
+ * the write is skipped if nothing changes. PCI_MODIFY_LOCK holds LOCK#
+ * over both, which is only defined for memory space.
+ * returns the old value.
+ */
+
+static uint32_t pci_modify(uint32_t addr, uint8_t rcmd, uint8_t wcmd, uint8_t bytes, uint32_t clear, uint32_t set, uint8_t flags) {
+	uint8_t shift = 8 * (addr & 0b11);
+	if (shift + 8 * bytes > 32) {
+		_unimplemented();
+	}
+	uint8_t be = ~(((1 << bytes) - 1) << (addr & 0b11)) & 0xf;
+	uint32_t old = master_modify(addr & ~0b11, rcmd, wcmd, be, clear << shift, set << shift, flags & PCI_MODIFY_LOCK);
+	note_status();
+	return old >> shift;
+}
+
+uint8_t pci_config_modify8(uint8_t addr, uint8_t clear, uint8_t set) {
+	return pci_modify(config_addr(addr), CMD_CONFIG_READ, CMD_CONFIG_WRITE, 1, clear, set, 0);
+}
+
+uint16_t pci_config_modify16(uint8_t addr, uint16_t clear, uint16_t set) {
+	return pci_modify(config_addr(addr), CMD_CONFIG_READ, CMD_CONFIG_WRITE, 2, clear, set, 0);
+}
+
+uint32_t pci_config_modify32(uint8_t addr, uint32_t clear, uint32_t set) {
+	return pci_modify(config_addr(addr), CMD_CONFIG_READ, CMD_CONFIG_WRITE, 4, clear, set, 0);
+}
+
+uint8_t pci_mem_modify8(uint32_t addr, uint8_t clear, uint8_t set, uint8_t flags) {
+	return pci_modify(addr, CMD_MEM_READ, CMD_MEM_WRITE, 1, clear, set, flags);
+}
+
+uint16_t pci_mem_modify16(uint32_t addr, uint16_t clear, uint16_t set, uint8_t flags) {
+	return pci_modify(addr, CMD_MEM_READ, CMD_MEM_WRITE, 2, clear, set, flags);
+}
+
+uint32_t pci_mem_modify32(uint32_t addr, uint32_t clear, uint32_t set, uint8_t flags) {
+	return pci_modify(addr, CMD_MEM_READ, CMD_MEM_WRITE, 4, clear, set, flags);
+}
+
+/* Write sequences
+ * writes to one target, fast back-to-back if the target has been found to
+ * support it, one by one otherwise.
+ * this only concerns us as the master. PCIM_CMD_BACKTOBACK in the card's
+ * command register would allow the card to do the same towards different
+ * targets, we do not set that.
+ */
+
+static uint8_t fast_b2b = 0;
+
+uint8_t pci_fast_b2b_enable(const struct pci_dev *dev) {
+	pci_select(dev);
+	fast_b2b = !!(pci_config_read16(PCIR_STATUS) & PCIM_STATUS_BACKTOBACK);
+	return fast_b2b;
+}
+
+void pci_fast_b2b_disable() {
+	fast_b2b = 0;
+}
+
+/* returns the number of writes that went through, they stop at the first
+ * one that did not
+ */
+uint8_t pci_mem_write_seq(const struct pci_write *w, uint8_t n) {
+	uint8_t done = 0;
+	if (fast_b2b) {
+		while (done < n) {
+			done += master_write_b2b(w + done, n - done, CMD_MEM_WRITE);
+			if (master_status() != MASTER_OK) {
+				break;
+			}
+		}
+		/* a Retry only ends the back-to-back part, w[done] has not
+		 * been taken yet and goes again with everything after it
+		 */
+		if (done == n || master_status() != MASTER_RETRY) {
+			note_status();
+			return done;
+		}
+	}
+	for (; done < n; done++) {
+		pci_write(w[done].addr, CMD_MEM_WRITE, w[done].be, w[done].value);
+		if (master_status() != MASTER_OK) {
+			break;
+		}
+	}
+	return done;
+}
@@ -2,7 +2,14 @@
 #define PCI_H
 
 #include <stdint.h>
+#include "pci/device.h"
+#include "pci/master_transaction.h"
 
+uint8_t pci_take_error();
+
+void pci_select_function(uint8_t fn);
+uint8_t pci_config_read8(uint8_t addr);
+uint16_t pci_config_read16(uint8_t addr);
 uint32_t pci_config_read32(uint8_t addr);
 void pci_config_write8(uint8_t addr, uint8_t val);
 void pci_config_write16(uint8_t addr, uint16_t val);
@@ -22,4 +29,27 @@ void pci_mem_write8(uint32_t addr, uint8_t val);
 void pci_mem_write16(uint32_t addr, uint16_t val);
 void pci_mem_write32(uint32_t addr, uint32_t val);
 
+uint32_t pci_mem64_read32(uint64_t addr);
+void pci_mem64_write32(uint64_t addr, uint32_t val);
+
+uint16_t pci_mem_read_burst(uint32_t addr, uint32_t *data, uint16_t n);
+uint16_t pci_mem_write_burst(uint32_t addr, uint32_t *data, uint16_t n);
+
+uint32_t pci_config_poll_until(uint8_t addr, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks);
+uint32_t pci_io_poll_until(uint32_t addr, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks);
+uint32_t pci_mem_poll_until(uint32_t addr, uint32_t mask, uint32_t match, uint32_t timeout_clocks, uint32_t *clocks);
+
+#define PCI_MODIFY_LOCK (1 << 0)
+
+uint8_t pci_config_modify8(uint8_t addr, uint8_t clear, uint8_t set);
+uint16_t pci_config_modify16(uint8_t addr, uint16_t clear, uint16_t set);
+uint32_t pci_config_modify32(uint8_t addr, uint32_t clear, uint32_t set);
+uint8_t pci_mem_modify8(uint32_t addr, uint8_t clear, uint8_t set, uint8_t flags);
+uint16_t pci_mem_modify16(uint32_t addr, uint16_t clear, uint16_t set, uint8_t flags);
+uint32_t pci_mem_modify32(uint32_t addr, uint32_t clear, uint32_t set, uint8_t flags);
+
+uint8_t pci_fast_b2b_enable(const struct pci_dev *dev);
+void pci_fast_b2b_disable();
+uint8_t pci_mem_write_seq(const struct pci_write *w, uint8_t n);
+
 #endif
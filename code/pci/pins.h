@@ -0,0 +1,34 @@
+#ifndef PCI_PINS_H
+#define PCI_PINS_H
+
+/* where the PCI signals are connected */
+
+/* port A */
+#define PA_INTA (1 << 7)
+#define PA_INTB (1 << 6)
+#define PA_INTC (1 << 4)
+#define PA_INTD (1 << 5)
+
+/* port B */
+#define PB_RST (1 << 6)
+#define PB_CLK (1 << 5)
+#define PB_GNT (1 << 4)
+#define PB_REQ (1 << 0)
+
+/* port F */
+#define PF_STOP    (1 << 6)
+#define PF_DEVSEL  (1 << 5)
+#define PF_TRDY    (1 << 4)
+#define PF_IRDY    (1 << 1)
+#define PF_FRAME   (1 << 0)
+
+/* port G */
+#define PG_IDSEL (1 << 5)
+
+/* port K */
+#define PK_PAR (1 << 7)
+#define PK_SERR (1 << 2)
+#define PK_PERR (1 << 1)
+#define PK_LOCK (1 << 0)
+
+#endif
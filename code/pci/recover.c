@@ -0,0 +1,52 @@
+#include <avr/interrupt.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include "console.h"
+#include "pci/arbiter.h"
+#include "pci/device.h"
+#include "pci/master_transaction.h"
+#include "pci/panic.h"
+#include "pci/recover.h"
+#include "pci/signals.h"
+
+jmp_buf pci_recover_jmp;
+uint8_t pci_recover_armed = 0;
+
+/* a card that keeps doing it is not going to get better */
+#define PCI_MAX_RECOVERIES 3
+
+static uint8_t recoveries = 0;
+
+/* the bus is in a state we cannot go on from. the card is held in reset
+ * right away, like panic() does, and everything else happens back at the
+ * recovery point.
+ */
+void pci_fail(const char *m) {
+	if (!pci_recover_armed || recoveries == PCI_MAX_RECOVERIES) {
+		panic(m);
+	}
+	disconnect_bus();
+	recoveries++;
+
+	console_str(m);
+	console_fstr(", resetting\n");
+	longjmp(pci_recover_jmp, 1);
+}
+
+/* second half, at the recovery point: a new bus reset, the cached config
+ * state goes back into the card. the drivers attach again after this.
+ * returns 0 if the card did not come back.
+ */
+uint8_t pci_reinit() {
+	/* pci_fail() may have left from inside an ATOMIC_BLOCK */
+	sei();
+
+	master_reset();
+	initialize_bus();
+	arbiter_reset();
+	return pci_restore();
+}
+
+uint8_t pci_recoveries() {
+	return recoveries;
+}
@@ -0,0 +1,19 @@
+#ifndef PCI_RECOVER_H
+#define PCI_RECOVER_H
+
+#include <setjmp.h>
+#include <stdint.h>
+
+/* recovery from errors that a bus reset can fix.
+ * main() sets pci_recover_armed and does a setjmp() on pci_recover_jmp,
+ * which pci_fail() comes back to. until then pci_fail() is a panic().
+ */
+
+extern jmp_buf pci_recover_jmp;
+extern uint8_t pci_recover_armed;
+
+__attribute__((noreturn)) void pci_fail(const char *m);
+uint8_t pci_reinit();
+uint8_t pci_recoveries();
+
+#endif
@@ -1,34 +1,8 @@
 #include <avr/io.h>
 #include <stdint.h>
-#include <util/delay.h>
-
-/* port A */
-#define PA_INTA (1 << 7)
-#define PA_INTB (1 << 6)
-#define PA_INTC (1 << 4)
-#define PA_INTD (1 << 5)
-
-/* port B */
-#define PB_RST (1 << 6)
-#define PB_CLK (1 << 5)
-#define PB_GNT (1 << 4)
-#define PB_REQ (1 << 0)
-
-/* port F */
-#define PF_STOP    (1 << 6)
-#define PF_DEVSEL  (1 << 5)
-#define PF_TRDY    (1 << 4)
-#define PF_IRDY    (1 << 1)
-#define PF_FRAME   (1 << 0)
-
-/* port G */
-#define PG_IDSEL (1 << 5)
-
-/* port K */
-#define PK_PAR (1 << 7)
-#define PK_SERR (1 << 2)
-#define PK_PERR (1 << 1)
-#define PK_LOCK (1 << 0)
+#include "pci/pins.h"
+#include "pci/signals.h"
+#include "timing.h"
 
 /* TODO: kill the "might not be inlinable" warnings */
 #define _force_inline __attribute__((always_inline))
@@ -115,6 +89,50 @@ _force_inline void clk_stop() {
 	clk_low();
 }
 
+/* GNT# line, we are the arbiter and always drive it */
+
+void gnt_assert() {
+	PORTB &= ~PB_GNT;
+}
+
+void gnt_deassert() {
+	PORTB |= PB_GNT;
+}
+
+/* LOCK# line, works like the port F control lines below */
+
+void assert_lock() {
+	DDRK |= PK_LOCK;
+	PORTK &= ~PK_LOCK;
+}
+
+void deassert_lock_1() {
+	PORTK |= PK_LOCK;
+}
+
+void deassert_lock_2() {
+	DDRK &= ~PK_LOCK;
+}
+
+int is_lock_asserted() {
+	return !(PINK & PK_LOCK);
+}
+
+/* PERR#, only ever driven by us for a parity error on read data */
+
+void assert_perr() {
+	DDRK |= PK_PERR;
+	PORTK &= ~PK_PERR;
+}
+
+void deassert_perr_1() {
+	PORTK |= PK_PERR;
+}
+
+void deassert_perr_2() {
+	DDRK &= ~PK_PERR;
+}
+
 /* a signal is asserted by
  * disabling the pullup (this causes the signal to be driven high for a moment)
  * driving it low
@@ -141,7 +159,17 @@ FUNCS_SIG(DEVSEL, devsel)
 FUNCS_SIG(TRDY,   trdy)
 FUNCS_SIG(IRDY,   irdy)
 
-void initialize_bus() {
+static uint32_t warmup_start;
+static uint8_t warmup_pending = 0;
+static uint32_t reset_start;
+
+/* keep reset active for some some time. spec says at least 1ms. */
+#define RESET_HOLD_CYCLES (2 * (F_CPU / 1000))
+
+/* the bus reset is split in two so that the boot can do other things while
+ * RST# is held, see pci_reset_done()
+ */
+void pci_reset_start() {
 	/* do a bus reset. for this, assert RST# first.
 	 * while we're at it, we start configuring port B correctly
 	 * (RST, CLK, GNT as outputs and initially low (GNT initially high)
@@ -188,27 +216,28 @@ void initialize_bus() {
 	/* address bus is completely tri-stated (TODO see above if pullup instead) */
 	ad_tristate();
 
-	/* keep reset active for some some time. spec says at least 1ms. */
-	_delay_ms(2);
+	reset_start = timing_now();
+}
+
+/* brings the card out of reset once it has been in there long enough.
+ * returns 0 if that is not yet the case.
+ */
+uint8_t pci_reset_done() {
+	if (timing_elapsed(reset_start) < RESET_HOLD_CYCLES) {
+		return 0;
+	}
 
 	/* bring device out of reset. */
 	PORTB |= PB_RST;
 
 	/* we're supposed to do some clock cycles before any configuration
 	 * accesses. According to spec, 2^25 cycles.
-	 * This might take some time on our MCU. Could save some with the timer
-	 * (CLK is conveniently placed on an output compare pin)
-	 * but it would still be some seconds.
-	 * As the whole setup is a giant hack anyway we just do some cycles
-	 * less and use what works.
-	 * We leave it up to the application to decide how many clock cycles
-	 * should happen. We just do one here. The Realtek cards are happy
-	 * with this.
-	 * If the application gets Master Aborts or Target Retrys during
-	 * enumeration it can just generate extra cycles as needed.
-	 * (start with e.g. 2^12 cycles and do another 2^12 ... 2^24 cycles
-	 * until enumeration succeeds. In total, 2^25 cycles will have happened
-	 * then.)
+	 * Bit-banging them would take ages, so the timer does it in the
+	 * background instead (CLK is conveniently placed on an output compare
+	 * pin), see pci_warmup_done().
+	 * The Realtek cards are happy with a lot less, so enumeration can
+	 * start right away and only has to retry while the warm-up is still
+	 * running.
 	 */
 
 	clk_high();
@@ -216,22 +245,46 @@ void initialize_bus() {
 
 	/* set up the clock timer. application can enable/disable with
 	 * clk_start/stop
+	 * OCR1A = 0 toggles CLK on every CPU cycle, F_CPU/2 is as fast as it
+	 * gets.
 	 */
 	TCCR1A = 0;
 	TCCR1B = (1 << WGM12) | (1 << CS10);
 	OCR1A = 0;
 
 	clk_start();
+	warmup_start = timing_now();
+	warmup_pending = 1;
+	timing_mark(TIMING_RST_RELEASED);
+	return 1;
+}
 
-	/* TODO - move this to a separate function so that the application
-	 * code can detect the necessity of extra cycles and handle accordingly.
-	 * TODO just make it use clk_start already
-	 */
-	if (0) for (uint32_t c = 0; c <= ((uint32_t)1 << (25-2)); c++) {
-		clk_high(); clk_low();
-		clk_high(); clk_low();
-		clk_high(); clk_low();
-		clk_high(); clk_low();
+void initialize_bus() {
+	pci_reset_start();
+	while (!pci_reset_done()) {
+	}
+}
+
+/* post-reset warm-up.
+ * the timer clock is only stopped for the few clocks of a bit-banged
+ * transaction, which toggle CLK themselves (just slower), so the elapsed
+ * time is good enough as a measure of the clocks that happened.
+ * timing_now() wraps after 2^32 CPU cycles, the warm-up takes 2^26, so
+ * this has to be looked at now and then until it is done; enumeration
+ * and pci_warmup_wait() do.
+ */
+
+#define WARMUP_CLOCKS ((uint32_t)1 << 25)
+
+uint8_t pci_warmup_done() {
+	if (warmup_pending && timing_elapsed(warmup_start) >= WARMUP_CLOCKS * CPU_CYCLES_PER_CLK) {
+		warmup_pending = 0;
+	}
+	return !warmup_pending;
+}
+
+void pci_warmup_wait() {
+	while (!pci_warmup_done()) {
 	}
 }
 
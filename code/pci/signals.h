@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+/* the free running CLK from timer 1, see initialize_bus() */
+#define CPU_CYCLES_PER_CLK 2
+
 void ad_output_mode();
 void ad_tristate();
 void ad_set(uint32_t v);
@@ -22,6 +25,18 @@ void clk_low();
 void clk_start();
 void clk_stop();
 
+void gnt_assert();
+void gnt_deassert();
+
+void assert_lock();
+void deassert_lock_1();
+void deassert_lock_2();
+int is_lock_asserted();
+
+void assert_perr();
+void deassert_perr_1();
+void deassert_perr_2();
+
 void assert_frame();
 void deassert_frame_1();
 void deassert_frame_2();
@@ -47,7 +62,11 @@ void deassert_irdy_1();
 void deassert_irdy_2();
 int is_irdy_asserted();
 
+void pci_reset_start();
+uint8_t pci_reset_done();
 void initialize_bus();
+uint8_t pci_warmup_done();
+void pci_warmup_wait();
 void disconnect_bus();
 
 #endif
@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "console.h"
+#include "pci/stats.h"
+
+#ifdef PCI_STATS
+
+struct pci_stats pci_stats;
+
+void pci_stats_get(struct pci_stats *s) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy(s, &pci_stats, sizeof(*s));
+	}
+}
+
+void pci_stats_reset() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memset(&pci_stats, 0, sizeof(pci_stats));
+	}
+}
+
+/* one "cmd:count" per used command, then the rest */
+void pci_stats_dump() {
+	struct pci_stats s;
+	pci_stats_get(&s);
+
+	for (uint8_t cmd = 0; cmd < 16; cmd++) {
+		if (s.by_cmd[cmd]) {
+			console_hex8(cmd);
+			console_fstr(":");
+			console_hex32(s.by_cmd[cmd]);
+			console_fstr(" ");
+		}
+	}
+	console_fstr("\nDS");
+	console_hex32(s.devsel_wait);
+	console_fstr(" TR");
+	console_hex32(s.trdy_wait);
+	console_fstr("\nBusy ");
+	console_hex32(s.busy_clocks);
+	console_fstr("\nMA");
+	console_hex16(s.master_aborts);
+	console_fstr(" TA");
+	console_hex16(s.target_aborts);
+	console_fstr(" R");
+	console_hex16(s.retries);
+	console_fstr(" D");
+	console_hex16(s.disconnects);
+	console_fstr(" P");
+	console_hex16(s.parity_errors);
+}
+
+#else
+
+void pci_stats_get(struct pci_stats *s) {
+	memset(s, 0, sizeof(*s));
+}
+
+void pci_stats_reset() {
+}
+
+void pci_stats_dump() {
+	console_fstr("no PCI_STATS");
+}
+
+#endif
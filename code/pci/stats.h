@@ -0,0 +1,39 @@
+#ifndef PCI_STATS_H
+#define PCI_STATS_H
+
+#include <stdint.h>
+
+/* counters kept by the transaction engine when built with -DPCI_STATS.
+ * all times are in PCI clocks.
+ */
+struct pci_stats {
+	uint32_t by_cmd[16];
+	uint32_t devsel_wait;  /* clocks until DEVSEL# was asserted */
+	uint32_t trdy_wait;    /* wait states, clocks until TRDY# */
+	uint32_t busy_clocks;  /* clocks with a transaction in progress */
+	uint16_t retries;
+	uint16_t disconnects;  /* bursts ended early by the target */
+	uint16_t master_aborts;
+	uint16_t target_aborts;
+	uint16_t parity_errors;
+};
+
+#ifdef PCI_STATS
+
+extern struct pci_stats pci_stats;
+
+#define STATS_INC(f) do { pci_stats.f++; } while (0)
+#define STATS_ADD(f, n) do { pci_stats.f += (n); } while (0)
+
+#else
+
+#define STATS_INC(f) do { } while (0)
+#define STATS_ADD(f, n) do { (void)(n); } while (0)
+
+#endif
+
+void pci_stats_get(struct pci_stats *s);
+void pci_stats_reset();
+void pci_stats_dump();
+
+#endif
@@ -0,0 +1,60 @@
+#include <avr/io.h>
+#include <stdint.h>
+#include "console.h"
+#include "trace.h"
+#include "pci/pins.h"
+#include "pci/signals.h"
+#include "pci/wave.h"
+
+#ifdef PCI_WAVE
+
+/* ring buffer, the oldest samples get overwritten */
+static struct wave_sample samples[WAVE_SAMPLES];
+static uint8_t wave_head = 0;
+static uint8_t wave_count = 0;
+
+void wave_sample(uint8_t flags) {
+	struct wave_sample *s = &samples[wave_head];
+	s->flags = flags;
+	s->ctl = PINF;
+	s->cbe_par = (PINA & 0x0f) | ((PINK & PK_PAR) ? 0x10 : 0);
+	s->ad = ad_get();
+
+	wave_head = (wave_head + 1) % WAVE_SAMPLES;
+	if (wave_count < WAVE_SAMPLES) {
+		wave_count++;
+	}
+}
+
+void wave_reset() {
+	wave_head = 0;
+	wave_count = 0;
+}
+
+void wave_dump() {
+	uint8_t first = (wave_head + WAVE_SAMPLES - wave_count) % WAVE_SAMPLES;
+	for (uint8_t i = 0; i < wave_count; i++) {
+		const struct wave_sample *s = &samples[(first + i) % WAVE_SAMPLES];
+#ifdef TRACE_SUPPORT
+		trace_event(TRACE_WAVE, s, sizeof(*s));
+#else
+		console_hex8(s->flags);
+		console_hex8(s->ctl);
+		console_hex8(s->cbe_par);
+		console_char(' ');
+		console_hex32(s->ad);
+		console_char('\n');
+#endif
+	}
+}
+
+#else
+
+void wave_reset() {
+}
+
+void wave_dump() {
+	console_fstr("no PCI_WAVE");
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PCI_WAVE_H
+#define PCI_WAVE_H
+
+#include <stdint.h>
+
+/* per-clock waveform capture, built with -DPCI_WAVE.
+ * one sample is taken right before every rising edge of CLK, i.e. exactly
+ * what a device on the bus sees. the samples go out as TRACE_WAVE frames
+ * and tools/tracedump turns them into a VCD file.
+ */
+
+#define WAVE_START (1 << 0) /* first clock of a transaction/capture */
+
+struct wave_sample {
+	uint8_t flags;
+	uint8_t ctl;     /* PINF: FRAME# IRDY# TRDY# DEVSEL# STOP# */
+	uint8_t cbe_par; /* C/BE# in bits 0-3, PAR in bit 4 */
+	uint32_t ad;
+};
+
+#define WAVE_SAMPLES 128
+
+#ifdef PCI_WAVE
+void wave_sample(uint8_t flags);
+#define WAVE_SAMPLE(flags) wave_sample(flags)
+#else
+#define WAVE_SAMPLE(flags) do { } while (0)
+#endif
+
+void wave_reset();
+void wave_dump();
+
+#endif
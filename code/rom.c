@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <util/crc16.h>
+#include "pci/pci.h"
+#include "pci/registers.h"
+
+#include "rom.h"
+
+#include "console.h"
+#include "trace.h"
+
+/* expansion ROM reader.
+ * the ROM BAR is mapped at base for as long as it takes, all images in it
+ * are looked at and then the whole thing goes out as TRACE_ROM frames,
+ * read with bursts. tools/tracedump puts it back together into a file and
+ * checks the CRC from the TRACE_ROM_END frame.
+ * without TRACE_SUPPORT it is hex dumped to the console instead, which is
+ * only of use with a UART.
+ */
+
+#define ROM_SIGNATURE 0xaa55
+#define ROM_PCIR_PTR  0x18
+
+/* PCI data structure, offsets from its start */
+#define ROMDS_SIGNATURE ((uint32_t)'P' | ((uint32_t)'C' << 8) | ((uint32_t)'I' << 16) | ((uint32_t)'R' << 24))
+#define ROMDS_VENDOR    0x04
+#define ROMDS_DEVICE    0x06
+#define ROMDS_IMAGELEN  0x10 /* in units of 512 bytes */
+#define ROMDS_CODETYPE  0x14
+#define ROMDS_INDICATOR 0x15
+#define ROMDS_LAST_IMAGE 0x80
+
+/* dwords per burst and per frame */
+#define ROM_CHUNK 16
+
+/* walk the image headers, returns how many bytes they cover */
+static uint32_t rom_images(const struct pci_dev *dev, uint32_t base, uint32_t size) {
+	uint32_t off = 0;
+	uint8_t indicator;
+
+	do {
+		if (pci_mem_read16(base + off) != ROM_SIGNATURE) {
+			console_fstr("no ROM signature\n");
+			break;
+		}
+		uint32_t pcir = base + off + pci_mem_read16(base + off + ROM_PCIR_PTR);
+		if (pci_mem_read32(pcir) != ROMDS_SIGNATURE) {
+			console_fstr("no PCIR\n");
+			break;
+		}
+		uint32_t len = (uint32_t)pci_mem_read16(pcir + ROMDS_IMAGELEN) * 512;
+		indicator = pci_mem_read8(pcir + ROMDS_INDICATOR);
+
+		console_fstr("ROM ");
+		console_hex32(off);
+		console_fstr(" T");
+		console_hex8(pci_mem_read8(pcir + ROMDS_CODETYPE));
+		console_fstr(" L");
+		console_hex32(len);
+		if (pci_mem_read16(pcir + ROMDS_VENDOR) != (dev->devvendor & 0xffff)
+			|| pci_mem_read16(pcir + ROMDS_DEVICE) != (dev->devvendor >> 16)) {
+			console_fstr(" ID?");
+		}
+		console_fstr("\n");
+
+		if (!len) {
+			break;
+		}
+		off += len;
+	} while (!(indicator & ROMDS_LAST_IMAGE) && off < size);
+
+	return off > size ? size : off;
+}
+
+static uint16_t rom_stream(uint32_t base, uint32_t len) {
+	struct {
+		uint32_t offset;
+		uint32_t data[ROM_CHUNK];
+	} f;
+	uint16_t crc = 0xffff;
+
+	for (f.offset = 0; f.offset < len; f.offset += 4 * ROM_CHUNK) {
+		uint8_t n = ROM_CHUNK;
+		if (len - f.offset < 4 * ROM_CHUNK) {
+			n = (len - f.offset + 3) / 4;
+		}
+		if (pci_mem_read_burst(base + f.offset, f.data, n) != n) {
+			console_fstr("ROM read failed\n");
+			break;
+		}
+
+		const uint8_t *p = (const uint8_t *)f.data;
+		for (uint8_t i = 0; i < 4 * n; i++) {
+			crc = _crc_ccitt_update(crc, p[i]);
+		}
+#ifdef TRACE_SUPPORT
+		trace_event(TRACE_ROM, &f, sizeof(f.offset) + 4 * n);
+#else
+		/* plain hex dump, one line per chunk */
+		console_hex32(f.offset);
+		console_fstr(":");
+		for (uint8_t i = 0; i < 4 * n; i++) {
+			console_hex8(p[i]);
+		}
+		console_fstr("\n");
+#endif
+	}
+
+#ifdef TRACE_SUPPORT
+	struct {
+		uint32_t len;
+		uint16_t crc;
+	} end = { f.offset < len ? f.offset : len, crc };
+	trace_event(TRACE_ROM_END, &end, sizeof(end));
+#endif
+
+	return crc;
+}
+
+/* base has to be a free memory address, aligned to the ROM size.
+ * returns the number of bytes streamed, 0 if there is no usable ROM.
+ */
+uint32_t rom_dump(struct pci_dev *dev, uint32_t base) {
+	pci_select(dev);
+
+	uint32_t old = pci_config_read32(PCIR_BIOS);
+	pci_config_write32(PCIR_BIOS, PCIM_BIOS_ADDR_MASK);
+	uint32_t mask = pci_config_read32(PCIR_BIOS) & PCIM_BIOS_ADDR_MASK;
+	if (!mask) {
+		pci_config_write32(PCIR_BIOS, old);
+		console_fstr("no ROM\n");
+		return 0;
+	}
+	uint32_t size = ~mask + 1;
+	if (base & ~mask) {
+		pci_config_write32(PCIR_BIOS, old);
+		console_fstr("ROM base not aligned\n");
+		return 0;
+	}
+
+	pci_config_write32(PCIR_BIOS, base | PCIM_BIOS_ENABLE);
+	uint16_t cmd = pci_config_read16(PCIR_COMMAND);
+	pci_config_write16(PCIR_COMMAND, cmd | PCIM_CMD_MEMEN);
+
+	uint32_t len = rom_images(dev, base, size);
+	if (len) {
+		uint16_t crc = rom_stream(base, len);
+		console_fstr("CRC ");
+		console_hex16(crc);
+		console_fstr("\n");
+	}
+
+	pci_config_write16(PCIR_COMMAND, cmd);
+	pci_config_write32(PCIR_BIOS, old);
+	return len;
+}
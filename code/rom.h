@@ -0,0 +1,9 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stdint.h>
+#include "pci/device.h"
+
+uint32_t rom_dump(struct pci_dev *dev, uint32_t base);
+
+#endif
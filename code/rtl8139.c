@@ -1,10 +1,16 @@
 #include "pci/pci.h"
 #include "pci/panic.h"
 #include "pci/registers.h"
+#include "pci/arbiter.h"
+#include "pci/device.h"
+
+#include "drivers.h"
+#include "rtl8139.h"
 
 #include "mii.h"
 
 #include "console.h"
+#include "events.h"
 #include <util/delay.h>
 
 typedef int bool;
@@ -79,6 +85,10 @@ typedef int bool;
 #define RTL_R8(reg) pci_mem_read8(IO_BASE + (reg))
 #define RTL_R16(reg) pci_mem_read16(IO_BASE + (reg))
 #define RTL_R32(reg) pci_mem_read32(IO_BASE + (reg))
+#define RTL_POLL(reg,mask,match) pci_mem_poll_until(IO_BASE + (reg), (mask), (match), RTL_POLL_CLOCKS, 0)
+
+/* the chip and PHY take some microseconds, so this is plenty */
+#define RTL_POLL_CLOCKS ((uint32_t)1 << 16)
 
 enum chip {
 	R8139, R8139K, R8139A, R8139AG, R8139B, R8130, R8139C, R8100, R8139D, R8101
@@ -125,29 +135,28 @@ static void detect_mac_version() {
 
 static void rtl8139_chip_reset() {
 	RTL_W8(Command, Command_Reset);
-	while (RTL_R8(Command) & Command_Reset) { }
+	if ((RTL_POLL(Command, Command_Reset, 0) & Command_Reset) || master_status() != MASTER_OK) {
+		console_fstr("reset timeout\n");
+	}
 }
 
-void rtl8139_init() {
-	/* Verify that this actually is a RTL8139 */
-	if (pci_config_read32(PCIR_DEVVENDOR) != 0x813910ec) {
-		panic("/Not a RTL8139");
+static uint8_t rtl8139_probe(struct pci_dev *dev) {
+	/* BARs were sized during enumeration */
+	if (dev->bar_size[0] != (0xffffff00 | PCIM_BAR_IO_SPACE)
+		|| dev->bar_size[1] != (0xffffff00 | PCIM_BAR_MEM_SPACE)) {
+		console_fstr("/Unexpected I/O BAR values");
+		return 1;
 	}
+	return 0;
+}
 
+static void rtl8139_attach(struct pci_dev *dev) {
 	console_fstr("r8139");
 
 	/* set up I/O base address register */
-	pci_config_write32(PCIR_BAR(0), 0xffffffff);
-	if (pci_config_read32(PCIR_BAR(0)) != (0xffffff00 | PCIM_BAR_IO_SPACE)) {
-		panic("/Unexpected I/O BAR values");
-	}
-	pci_config_write32(PCIR_BAR(0), IO_BASE);
-
-	pci_config_write32(PCIR_BAR(1), 0xffffffff);
-	if (pci_config_read32(PCIR_BAR(1)) != (0xffffff00 | PCIM_BAR_MEM_SPACE)) {
-		panic("/Unexpected I/O BAR values");
-	}
-	pci_config_write32(PCIR_BAR(1), IO_BASE);
+	pci_bar_assign(dev, 0, IO_BASE);
+	pci_bar_assign(dev, 1, IO_BASE);
+	pci_fast_b2b_enable(dev);
 
 
 	/* configure command register.
@@ -208,9 +217,12 @@ void rtl8139_init() {
 	RTL_W8(Command, Command_RxEn | Command_TxEn);
 	RTL_W32(TxConfig, 0x03000000 | 0x00000700);
 	RTL_W32(RxConfig, /* RxConfig_RXFTH_No */ (0b011UL << 13) | (0b11 << 11) | RxConfig_MXDMA_Unlimited | RxConfig_AAP | RxConfig_AB | RxConfig_AM | RxConfig_APM | 0b111111);
-	RTL_W32(MulticastReg0, 0xffffffff);
-	RTL_W32(MulticastReg0+4, 0xffffffff);
-	RTL_W32(MissedPkt, 0);
+	const struct pci_write init_seq[] = {
+		{ IO_BASE + MulticastReg0,     0b0000, 0xffffffff },
+		{ IO_BASE + MulticastReg0 + 4, 0b0000, 0xffffffff },
+		{ IO_BASE + MissedPkt,         0b0000, 0 },
+	};
+	pci_mem_write_seq(init_seq, sizeof(init_seq) / sizeof(init_seq[0]));
 	RTL_W16(IntStatus, 0x20);
 	RTL_W8(Command, Command_RxEn | Command_TxEn);
 
@@ -218,6 +230,8 @@ void rtl8139_init() {
 
 	while (1) {
 		console_reset();
+		events_drain();
+		arbiter_idle();
 
 		uint16_t is = RTL_R16(IntStatus);
 		console_fstr("I:Rx[");
@@ -256,8 +270,22 @@ void rtl8139_init() {
 			console_char('r');
 		}
 
+		/* how quickly it gets the bus for its FIFOs */
+		struct arb_stats as;
+		arbiter_stats_get(&as);
+		console_fstr("\nG ");
+		console_hex16(as.grants);
+		console_fstr(" L ");
+		console_hex16(as.grant_latency_max > 0xffff ? 0xffff : as.grant_latency_max);
+
+		uint8_t err = pci_take_error();
+		if (err) {
+			console_fstr(" E");
+			console_hex8(err);
+		}
+
 		_delay_ms(500);
 	}
 }
 
-
+const __flash struct pci_driver rtl8139_driver = { rtl8139_probe, rtl8139_attach };
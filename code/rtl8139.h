@@ -1,6 +1,8 @@
 #ifndef RTL8139_H
 #define RTL8139_H
 
-void rtl8139_init();
+#include "drivers.h"
+
+extern const __flash struct pci_driver rtl8139_driver;
 
 #endif
@@ -1,10 +1,16 @@
 #include "pci/pci.h"
 #include "pci/panic.h"
 #include "pci/registers.h"
+#include "pci/arbiter.h"
+#include "pci/device.h"
+
+#include "drivers.h"
+#include "rtl8169.h"
 
 #include "mii.h"
 
 #include "console.h"
+#include "events.h"
 #include <util/delay.h>
 
 typedef int bool;
@@ -85,6 +91,11 @@ typedef int bool;
 #define RTL_R8(reg) pci_mem_read8(IO_BASE + (reg))
 #define RTL_R16(reg) pci_mem_read16(IO_BASE + (reg))
 #define RTL_R32(reg) pci_mem_read32(IO_BASE + (reg))
+#define RTL_MODIFY8(reg,clear,set) pci_mem_modify8(IO_BASE + (reg), (clear), (set), 0)
+#define RTL_POLL(reg,mask,match) pci_mem_poll_until(IO_BASE + (reg), (mask), (match), RTL_POLL_CLOCKS, 0)
+
+/* the chip and PHY take some microseconds, so this is plenty */
+#define RTL_POLL_CLOCKS ((uint32_t)1 << 16)
 
 /* similar to Linux driver:
  * 01 = 8169
@@ -98,46 +109,30 @@ typedef int bool;
 static uint8_t mac_ver;
 
 static void writephy(uint8_t loc, uint16_t val) {
-	/*
 	RTL_W32(PhyAccess, PhyAccess_Write
 		| ((uint32_t)(loc & 0x1f) << PhyAccess_AddrSh)
 		| (uint32_t)(val << PhyAccess_DataSh));
 
-	while (RTL_R32(PhyAccess) & PhyAccess_Write) { _delay_us(25); }
-	_delay_us(20);
-	*/
-	console_fstr("B:");
-	console_hex32(RTL_R32(PhyAccess));
-	RTL_W32(PhyAccess, PhyAccess_Write
-		| ((uint32_t)(loc & 0x1f) << PhyAccess_AddrSh)
-		| (uint32_t)(val << PhyAccess_DataSh));
-	while (1) {
-		RTL_R32(0);
-		uint32_t r = RTL_R32(PhyAccess);
-		console_char(' ');
+	/* the flag is cleared once the PHY has taken the value */
+	uint32_t r = RTL_POLL(PhyAccess, PhyAccess_Write, 0);
+	if ((r & PhyAccess_Write) || master_status() != MASTER_OK) {
+		console_fstr("PHY write timeout ");
 		console_hex32(r);
-		if (!(r & PhyAccess_Write)) { break; }
-		_delay_ms(1000);
 	}
+	_delay_us(20);
 }
 
 static uint16_t readphy(uint8_t loc) {
-	console_fstr("B:");
-	console_hex32(RTL_R32(PhyAccess));
 	RTL_W32(PhyAccess, (uint32_t)(loc & 0x1f) << PhyAccess_AddrSh);
-	while (1) {
-		uint32_t r = RTL_R32(PhyAccess);
-		console_char(' ');
+
+	/* the flag is set once the data is there */
+	uint32_t r = RTL_POLL(PhyAccess, PhyAccess_Write, PhyAccess_Write);
+	if (!(r & PhyAccess_Write) || master_status() != MASTER_OK) {
+		console_fstr("PHY read timeout ");
 		console_hex32(r);
-		if ((r & PhyAccess_Write)) { return r & 0xffff; }
-		_delay_ms(1000);
-
-		/*
-		uint32_t r = RTL_R32(PhyAccess);
-		if (r & PhyAccess_Write) {
-			return r & 0xffff;
-		} */
+		return 0;
 	}
+	return r & 0xffff;
 }
 
 /* XMII */
@@ -273,7 +268,9 @@ static void init_rxcfg() {
 
 static void hw_reset() {
 	RTL_W8(Command, Command_Reset);
-	while (RTL_R8(Command) & Command_Reset) { }
+	if ((RTL_POLL(Command, Command_Reset, 0) & Command_Reset) || master_status() != MASTER_OK) {
+		console_fstr("reset timeout\n");
+	}
 } /* TODO: rtl8169_hw_reset da oben rein portieren */
 
 static void init_txcfg() {
@@ -329,27 +326,21 @@ static void hw_start() {
 
 
 
-void rtl8169_init() {
-	/* Verify that this actually is a RTL8169 */
-	if (pci_config_read32(PCIR_DEVVENDOR) != 0x816910ec) {
-		panic("/Not a RTL8169");
+static uint8_t rtl8169_probe(struct pci_dev *dev) {
+	/* BARs were sized during enumeration. only the memory BAR is used */
+	if (dev->bar_size[1] != (0xffffff00 | PCIM_BAR_MEM_SPACE)) {
+		console_fstr("/Unexpected I/O BAR values");
+		return 1;
 	}
+	return 0;
+}
 
+static void rtl8169_attach(struct pci_dev *dev) {
 	console_fstr("r8169");
 
 	/* set up I/O base address register */
-	/*
-	pci_config_write32(PCIR_BAR(0), 0xffffffff);
-	if (pci_config_read32(PCIR_BAR(0)) != (0xffffff00 | PCIM_BAR_IO_SPACE)) {
-		panic("/Unexpected I/O BAR values");
-	}
-	pci_config_write32(PCIR_BAR(0), IO_BASE);
-	*/
-	pci_config_write32(PCIR_BAR(1), 0xffffffff);
-	if (pci_config_read32(PCIR_BAR(1)) != (0xffffff00 | PCIM_BAR_MEM_SPACE)) {
-		panic("/Unexpected I/O BAR values");
-	}
-	pci_config_write32(PCIR_BAR(1), IO_BASE);
+	/* pci_bar_assign(dev, 0, IO_BASE); */
+	pci_bar_assign(dev, 1, IO_BASE);
 
 	/* configure command register.
 	 * card should respond to register accesses in I/O space (but not in
@@ -372,8 +363,8 @@ void rtl8169_init() {
 	hw_reset();
 
 	RTL_W8(Cmd9346, Cmd9346_WE);
-	RTL_W8(Config1, RTL_R8(Config1) | (1<<0));
-	RTL_W8(Config5, RTL_R8(Config5) & 0b1110011);
+	RTL_MODIFY8(Config1, 0, (1<<0));
+	RTL_MODIFY8(Config5, (uint8_t)~0b1110011, 0);
 	RTL_W8(Cmd9346, 0);
 
 	/* can dump MAC address now */
@@ -393,12 +384,19 @@ void rtl8169_init() {
 	*/
 
 	while (1) {
+		events_drain();
+		arbiter_idle();
 		console_hex16(RTL_R16(IntStatus));
 		console_char(' ');
 		console_hex8(RTL_R8(PhyStatus));
+		uint8_t err = pci_take_error();
+		if (err) {
+			console_fstr(" E");
+			console_hex8(err);
+		}
 		console_fstr("   ");
 		_delay_ms(500);
 	}
 }
 
-
+const __flash struct pci_driver rtl8169_driver = { rtl8169_probe, rtl8169_attach };
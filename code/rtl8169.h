@@ -1,6 +1,8 @@
 #ifndef RTL8169_H
 #define RTL8169_H
 
-void rtl8169_init();
+#include "drivers.h"
+
+extern const __flash struct pci_driver rtl8169_driver;
 
 #endif
@@ -1,79 +1,100 @@
 #include <stdint.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include "console.h"
-#include "pci/panic.h"
+#include "timing.h"
+
+/* timer 3 runs at the CPU clock, the overflow interrupt counts the upper 16
+ * bits in software
+ */
+static volatile uint16_t timing_hi = 0;
 
 ISR(TIMER3_OVF_vect) {
-	/* we abuse Timer 4 value as higher-order bits */
-	TCNT4++;
+	timing_hi++;
 }
 
+#define TIMING_DEPTH 4
+static uint32_t scope_start[TIMING_DEPTH];
+static uint8_t scope_depth = 0;
+
+/* what a timing_start()/timing_end() pair (and the 16 bit variant) costs by
+ * itself, subtracted from every measurement
+ */
+static uint16_t overhead = 0;
+uint16_t timing_overhead16 = 0;
+
 void timing_init() {
 	TCCR3A = 0;
 	TCCR3B = (1 << CS30);
 	TIMSK3 |= (1 << TOIE3);
-	/* interrupts must be enabled for higher 16 bits */
+	/* interrupts must be enabled for the higher 16 bits */
+
+	timing_start();
+	overhead = timing_end();
+
+	uint16_t t = timing_now16();
+	timing_overhead16 = timing_now16() - t;
 }
 
-static uint16_t s_c3, s_c4a, s_c4b;
-static uint16_t e_c3, e_c4a, e_c4b;
+/* CPU cycles since timing_init(). wraps after 2^32 cycles (4.5 minutes) */
+uint32_t timing_now() {
+	uint16_t lo, hi;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		lo = TCNT3;
+		hi = timing_hi;
+		/* overflowed, but the interrupt did not get to run yet */
+		if ((TIFR3 & (1 << TOV3)) && lo < 0x8000) {
+			hi++;
+		}
+	}
+	return ((uint32_t)hi << 16) | lo;
+}
+
+uint32_t timing_elapsed(uint32_t since) {
+	return timing_now() - since;
+}
 
+/* measurement scopes, they can be nested TIMING_DEPTH deep */
 void timing_start() {
-	s_c4a = TCNT4;
-	s_c3  = TCNT3;
-	s_c4b = TCNT4;
+	if (scope_depth < TIMING_DEPTH) {
+		scope_start[scope_depth] = timing_now();
+	}
+	scope_depth++;
 }
 
-void timing_end() {
-	e_c4a = TCNT4;
-	e_c3  = TCNT3;
-	e_c4b = TCNT4;
-
-	uint16_t s_c4, e_c4;
-
-	if (s_c4a == s_c4b) {
-		s_c4 = s_c4a;
-	} else if (s_c4a + 1 == s_c4b) {
-		console_fstr("*");
-		if (s_c3 < 0x8000) {
-			s_c4 = s_c4b;
-		} else {
-			s_c4 = s_c4a;
-		}
-	} else {
-		console_fstr("Tstart:");
-		console_hex16(s_c4a);
-		console_fstr("/");
-		console_hex16(s_c3);
-		console_fstr("/");
-		console_hex16(s_c4b);
-		panic("");
+/* cycles since the matching timing_start() */
+uint32_t timing_end() {
+	uint32_t now = timing_now();
+	if (scope_depth == 0) {
+		return 0;
+	}
+	scope_depth--;
+	if (scope_depth >= TIMING_DEPTH) {
+		return 0;
 	}
 
-	if (e_c4a == e_c4b) {
-		e_c4 = e_c4a;
-	} else if (e_c4a + 1 == e_c4b) {
-		console_fstr("*");
-		if (e_c3 < 0x8000) {
-			e_c4 = e_c4b;
-		} else {
-			e_c4 = e_c4a;
-		}
-	} else {
-		console_fstr("Tend:");
-		console_hex16(e_c4a);
-		console_fstr("/");
-		console_hex16(e_c3);
-		console_fstr("/");
-		console_hex16(e_c4b);
-		panic("");
+	uint32_t t = now - scope_start[scope_depth];
+	return (t > overhead) ? t - overhead : 0;
+}
+
+/* only the first time counts, later bus resets do not move them */
+static uint32_t marks[TIMING_MARKS];
+
+void timing_mark(uint8_t m) {
+	if (!marks[m]) {
+		marks[m] = timing_now();
 	}
+}
 
-	uint32_t tdiff = (e_c3 | (uint32_t)(e_c4) << 16) - (s_c3 | (uint32_t)(s_c4) << 16);
+/* 0 if it did not happen (yet) */
+uint32_t timing_mark_get(uint8_t m) {
+	return marks[m];
+}
 
-	uint16_t sec = tdiff / F_CPU;
-	uint16_t msec = (tdiff / (F_CPU / 1000)) % 1000;
+void timing_print(uint32_t cycles) {
+	uint16_t sec = cycles / F_CPU;
+	uint16_t msec = (cycles / (F_CPU / 1000)) % 1000;
 	uint8_t msec100 = (msec / 100) % 10;
 	uint8_t msec10 = (msec / 10) % 10;
 	uint8_t msec1 = msec % 10;
@@ -84,4 +105,3 @@ void timing_end() {
 	console_char(msec1 + '0');
 	console_fstr("s");
 }
-
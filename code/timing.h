@@ -1,8 +1,35 @@
 #ifndef TIMING_H
 #define TIMING_H
 
+#include <stdint.h>
+#include <avr/io.h>
+
 void timing_init();
+uint32_t timing_now();
+uint32_t timing_elapsed(uint32_t since);
 void timing_start();
-void timing_end();
+uint32_t timing_end();
+void timing_print(uint32_t cycles);
+
+/* boot milestones, in cycles since timing_init() */
+enum timing_mark {
+	TIMING_RST_RELEASED,
+	TIMING_FIRST_CONFIG, /* first config read the card answered */
+	TIMING_MARKS
+};
+
+void timing_mark(uint8_t m);
+uint32_t timing_mark_get(uint8_t m);
+
+/* cheap variant for intervals shorter than 4ms: only the hardware counter */
+extern uint16_t timing_overhead16;
+
+static inline uint16_t timing_now16() {
+	return TCNT3;
+}
+
+static inline uint16_t timing_elapsed16(uint16_t since) {
+	return TCNT3 - since - timing_overhead16;
+}
 
 #endif
@@ -0,0 +1,41 @@
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "trace.h"
+#include "uart.h"
+
+#ifdef TRACE_SUPPORT
+
+#ifndef UART_SUPPORT
+#error "TRACE_SUPPORT needs UART_SUPPORT"
+#endif
+
+void trace_event(uint8_t id, const void *payload, uint8_t len) {
+	const uint8_t *p = payload;
+	uint8_t sum = id + len;
+
+	/* frames from interrupts must not end up in the middle of ours */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uart_putc(TRACE_SYNC);
+		uart_putc(id);
+		uart_putc(len);
+		for (uint8_t i = 0; i < len; i++) {
+			uart_putc(p[i]);
+			sum += p[i];
+		}
+		uart_putc(sum);
+	}
+}
+
+void trace_transaction(uint8_t id, uint32_t addr, uint8_t cmd, uint8_t be, uint32_t data) {
+	struct {
+		uint32_t addr;
+		uint8_t cmd;
+		uint8_t be;
+		uint32_t data;
+	} t = { addr, cmd, be, data };
+
+	trace_event(id, &t, sizeof(t));
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* binary trace frames on the serial console:
+ *   TRACE_SYNC, id, payload length, payload, checksum
+ * the checksum is the 8 bit sum of id, length and payload. multi-byte
+ * values are little endian.
+ * text never contains TRACE_SYNC, so frames and text can share the line.
+ * tools/tracedump decodes it on the host.
+ */
+
+#define TRACE_SYNC 0xfe
+
+enum trace_id {
+	TRACE_MASTER_READ  = 0x01, /* addr32 cmd8 be8 data32 */
+	TRACE_MASTER_WRITE = 0x02, /* addr32 cmd8 be8 data32 */
+	TRACE_MONITOR      = 0x03, /* clock16 kind8 cbe_par8 ad32 (pci/monitor.h) */
+	TRACE_WAVE         = 0x04, /* flags8 ctl8 cbe_par8 ad32 (pci/wave.h) */
+	TRACE_ROM          = 0x05, /* offset32 data (up to 64 bytes) */
+	TRACE_ROM_END      = 0x06, /* len32 crc16 (CRC-CCITT, init 0xffff) */
+	TRACE_FLIGHT       = 0x07, /* time32 addr32 data32 cmd_be8 status8 (pci/flight.h) */
+};
+
+#ifdef TRACE_SUPPORT
+
+void trace_event(uint8_t id, const void *payload, uint8_t len);
+void trace_transaction(uint8_t id, uint32_t addr, uint8_t cmd, uint8_t be, uint32_t data);
+
+#else
+
+#define trace_event(id, payload, len) do { } while (0)
+#define trace_transaction(id, addr, cmd, be, data) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "uart.h"
+
+#ifdef UART_SUPPORT
+
+/* serial console on USART1 (TXD1 = PD3). USART0, 2 and 3 share their pins
+ * with the AD lines.
+ * bytes go into a FIFO which is emptied by the data register empty
+ * interrupt.
+ */
+
+#ifndef UART_BAUD
+#define UART_BAUD 1000000UL
+#endif
+
+#define UART_FIFO_SIZE 128 /* power of 2 */
+
+static uint8_t tx_fifo[UART_FIFO_SIZE];
+static volatile uint8_t tx_head = 0, tx_tail = 0;
+
+static void tx_next() {
+	UDR1 = tx_fifo[tx_tail];
+	tx_tail = (tx_tail + 1) & (UART_FIFO_SIZE - 1);
+}
+
+ISR(USART1_UDRE_vect) {
+	if (tx_head == tx_tail) {
+		UCSR1B &= ~(1 << UDRIE1);
+	} else {
+		tx_next();
+	}
+}
+
+void uart_init() {
+	UBRR1 = F_CPU / 8 / UART_BAUD - 1;
+	UCSR1A = (1 << U2X1);
+	UCSR1C = (1 << UCSZ11) | (1 << UCSZ10); /* 8N1 */
+	UCSR1B = (1 << TXEN1);
+}
+
+void uart_putc(uint8_t c) {
+	uint8_t sync = !(SREG & (1 << SREG_I));
+
+	while (1) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			uint8_t next = (tx_head + 1) & (UART_FIFO_SIZE - 1);
+			if (next != tx_tail) {
+				tx_fifo[tx_head] = c;
+				tx_head = next;
+				UCSR1B |= (1 << UDRIE1);
+				return;
+			}
+
+			/* full. with interrupts disabled nobody else is going
+			 * to make room, so send a byte by hand.
+			 */
+			if (sync) {
+				while (!(UCSR1A & (1 << UDRE1))) { }
+				tx_next();
+			}
+		}
+	}
+}
+
+void uart_write(const uint8_t *p, uint8_t len) {
+	while (len--) {
+		uart_putc(*p++);
+	}
+}
+
+void uart_flush() {
+	if (SREG & (1 << SREG_I)) {
+		while (tx_head != tx_tail) { }
+	} else {
+		while (tx_head != tx_tail) {
+			while (!(UCSR1A & (1 << UDRE1))) { }
+			tx_next();
+		}
+	}
+}
+
+#endif
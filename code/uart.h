@@ -0,0 +1,11 @@
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+
+void uart_init();
+void uart_putc(uint8_t);
+void uart_write(const uint8_t *, uint8_t);
+void uart_flush();
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <string.h>
+#include "pci/pci.h"
+#include "pci/registers.h"
+
+#include "vpd.h"
+
+#include "console.h"
+
+/* Vital Product Data.
+ * the VPD capability hands out one dword at a time: write the address with
+ * the flag cleared, wait for the device to set the flag, read the data.
+ * the next address is written as soon as the data has been read, so the
+ * card fetches it while we take the previous dword apart.
+ */
+
+#define VPD_MAX_ADDR 0x8000
+#define VPD_TIMEOUT_CLOCKS ((uint32_t)1 << 16)
+
+/* resource tags */
+#define VPD_LARGE   0x80
+#define VPD_ID      0x02 /* large: identifier string */
+#define VPD_RO      0x10 /* large: read-only keywords */
+#define VPD_RW      0x11 /* large: read/write keywords */
+#define VPD_END     0x0f /* small: end tag */
+
+enum vpd_state {
+	S_TAG,
+	S_LEN_LO,
+	S_LEN_HI,
+	S_SKIP,   /* resource that is not looked at */
+	S_ID,     /* identifier string */
+	S_KW0,    /* keyword, first and second character */
+	S_KW1,
+	S_KWLEN,
+	S_KWDATA,
+};
+
+static struct {
+	uint8_t state;
+	uint8_t tag;
+	uint16_t left;    /* bytes left in the current resource */
+	uint8_t key0;
+	uint8_t kw_left;  /* bytes left in the current keyword */
+	uint8_t checksum; /* first data byte of RV is the checksum */
+	uint8_t sum;
+	uint8_t done;
+	struct vpd_entry *cur;
+} p;
+
+static struct vpd_entry *new_entry(struct vpd *v, char k0, char k1) {
+	if (v->n == VPD_MAX_ENTRIES) {
+		return 0;
+	}
+	struct vpd_entry *e = &v->e[v->n++];
+	e->key[0] = k0;
+	e->key[1] = k1;
+	e->len = 0;
+	e->value[0] = 0;
+	return e;
+}
+
+static void add_char(uint8_t b) {
+	if (p.cur && p.cur->len < VPD_VALUE_MAX) {
+		p.cur->value[p.cur->len++] = b;
+		p.cur->value[p.cur->len] = 0;
+	}
+}
+
+/* end of one resource's worth of data */
+static void resource_byte_done() {
+	if (--p.left == 0) {
+		p.state = S_TAG;
+	}
+}
+
+static void vpd_byte(struct vpd *v, uint8_t b) {
+	p.sum += b;
+
+	switch (p.state) {
+	case S_TAG:
+		if (b & VPD_LARGE) {
+			p.tag = b & ~VPD_LARGE;
+			p.state = S_LEN_LO;
+		} else if (((b >> 3) & 0x0f) == VPD_END) {
+			p.done = 1;
+		} else {
+			p.left = b & 0b111;
+			p.state = p.left ? S_SKIP : S_TAG;
+		}
+		break;
+	case S_LEN_LO:
+		p.left = b;
+		p.state = S_LEN_HI;
+		break;
+	case S_LEN_HI:
+		p.left |= (uint16_t)b << 8;
+		if (!p.left) {
+			p.state = S_TAG;
+		} else if (p.tag == VPD_ID) {
+			p.cur = new_entry(v, 'I', 'D');
+			p.state = S_ID;
+		} else if (p.tag == VPD_RO || p.tag == VPD_RW) {
+			p.state = S_KW0;
+		} else {
+			p.state = S_SKIP;
+		}
+		break;
+	case S_SKIP:
+		resource_byte_done();
+		break;
+	case S_ID:
+		add_char(b);
+		resource_byte_done();
+		break;
+	case S_KW0:
+		p.key0 = b;
+		p.state = S_KW1;
+		resource_byte_done();
+		break;
+	case S_KW1:
+		/* RV is the checksum, RW just unused space */
+		if (p.key0 == 'R' && (b == 'V' || b == 'W')) {
+			p.checksum = (b == 'V');
+			p.cur = 0;
+		} else {
+			p.cur = new_entry(v, p.key0, b);
+		}
+		p.state = S_KWLEN;
+		resource_byte_done();
+		break;
+	case S_KWLEN:
+		p.kw_left = b;
+		p.state = b ? S_KWDATA : S_KW0;
+		resource_byte_done();
+		break;
+	case S_KWDATA:
+		if (p.checksum) {
+			/* all bytes up to and including this one sum up to 0 */
+			v->checksum_ok = (p.sum == 0);
+			p.checksum = 0;
+		}
+		add_char(b);
+		if (--p.kw_left == 0) {
+			p.state = S_KW0;
+		}
+		resource_byte_done();
+		break;
+	}
+}
+
+/* wait for the flag to say the dword at the last address is there */
+static uint8_t vpd_wait(uint8_t cap) {
+	uint16_t flag = pci_config_poll_until(cap + PCIR_VPD_ADDR, PCIM_VPD_FLAG, PCIM_VPD_FLAG, VPD_TIMEOUT_CLOCKS, 0);
+	if ((flag & PCIM_VPD_FLAG) && master_status() == MASTER_OK) {
+		return 1;
+	}
+	console_fstr("VPD timeout\n");
+	return 0;
+}
+
+/* returns the number of entries found */
+uint8_t vpd_read(struct pci_dev *dev, struct vpd *v) {
+	memset(v, 0, sizeof(*v));
+	memset(&p, 0, sizeof(p));
+
+	uint8_t cap = pci_find_cap(dev, PCIY_VPD);
+	if (!cap) {
+		return 0;
+	}
+	pci_select(dev);
+
+	uint16_t addr = 0;
+	pci_config_write16(cap + PCIR_VPD_ADDR, addr);
+	while (addr < VPD_MAX_ADDR) {
+		if (!vpd_wait(cap)) {
+			return v->n;
+		}
+		uint32_t data = pci_config_read32(cap + PCIR_VPD_DATA);
+		if (p.done) {
+			/* this was only read to finish the pending access */
+			break;
+		}
+
+		addr += 4;
+		if (addr < VPD_MAX_ADDR) {
+			pci_config_write16(cap + PCIR_VPD_ADDR, addr);
+		}
+		for (uint8_t i = 0; i < 4 && !p.done; i++) {
+			vpd_byte(v, data >> (8 * i));
+		}
+	}
+
+	return v->n;
+}
+
+const struct vpd_entry *vpd_find(const struct vpd *v, const char *key) {
+	for (uint8_t i = 0; i < v->n; i++) {
+		if (v->e[i].key[0] == key[0] && v->e[i].key[1] == key[1]) {
+			return &v->e[i];
+		}
+	}
+	return 0;
+}
+
+void vpd_dump(const struct vpd *v) {
+	for (uint8_t i = 0; i < v->n; i++) {
+		console_char(v->e[i].key[0]);
+		console_char(v->e[i].key[1]);
+		console_fstr(" ");
+		console_str(v->e[i].value);
+		console_fstr("\n");
+	}
+	if (!v->checksum_ok) {
+		console_fstr("VPD checksum?\n");
+	}
+}
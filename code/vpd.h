@@ -0,0 +1,27 @@
+#ifndef VPD_H
+#define VPD_H
+
+#include <stdint.h>
+#include "pci/device.h"
+
+#define VPD_MAX_ENTRIES 8
+#define VPD_VALUE_MAX   24 /* longer values are cut off */
+
+/* the identifier string is stored under the key "ID" */
+struct vpd_entry {
+	char key[2];
+	uint8_t len;
+	char value[VPD_VALUE_MAX + 1];
+};
+
+struct vpd {
+	uint8_t n;
+	uint8_t checksum_ok; /* RV keyword was present and matched */
+	struct vpd_entry e[VPD_MAX_ENTRIES];
+};
+
+uint8_t vpd_read(struct pci_dev *dev, struct vpd *v);
+const struct vpd_entry *vpd_find(const struct vpd *v, const char *key);
+void vpd_dump(const struct vpd *v);
+
+#endif
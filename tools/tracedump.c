@@ -0,0 +1,357 @@
+/* decode the serial console of the board on the host.
+ * text is passed through, binary trace frames (see code/trace.h) are
+ * printed one per line.
+ * waveform samples (-DPCI_WAVE) are decoded into transactions with their
+ * length in clocks, and with -w also written to a VCD file for GTKWave.
+ * an expansion ROM dump is written to the file given with -r.
+ * the flight recorder saved by the last panic comes out at boot.
+ *
+ *   cc -o tracedump tracedump.c
+ *   stty -F /dev/ttyUSB0 raw 1000000
+ *   ./tracedump [-w bus.vcd] [-r rom.bin] < /dev/ttyUSB0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../code/trace.h"
+
+static const char *cmd_names[16] = {
+	[0b0010] = "IO_READ",     [0b0011] = "IO_WRITE",
+	[0b0110] = "MEM_READ",    [0b0111] = "MEM_WRITE",
+	[0b1010] = "CFG_READ",    [0b1011] = "CFG_WRITE",
+	[0b1100] = "MEM_READ_MULT", [0b1101] = "DUAL_ADDRESS",
+	[0b1110] = "MEM_READ_LINE",
+	[0b1111] = "MEM_WRITE_INV",
+};
+
+static uint32_t le32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void print_transaction(const char *dir, const uint8_t *p, uint8_t len) {
+	if (len < 10) {
+		printf("short %s frame\n", dir);
+		return;
+	}
+	const char *cmd = cmd_names[p[4] & 0xf];
+	printf("%s %-13s %08x be=%x %08x\n", dir, cmd ? cmd : "?",
+		le32(p), p[5] & 0xf, le32(p + 6));
+}
+
+static void print_monitor(const uint8_t *p, uint8_t len) {
+	static const char *kinds[] = { "addr", "data", "stop" };
+	if (len < 8) {
+		printf("short monitor frame\n");
+		return;
+	}
+	uint8_t kind = p[2];
+	uint8_t cbe = p[3] & 0xf;
+	const char *cmd = cmd_names[cbe];
+	printf("M %5u %s ", p[0] | (p[1] << 8), kind < 3 ? kinds[kind] : "?");
+	if (kind == 0) {
+		printf("%-13s %08x", cmd ? cmd : "?", le32(p + 4));
+	} else if (kind == 1) {
+		printf("be=%x %08x", cbe, le32(p + 4));
+	} else {
+		printf("ctl=%02x", p[4]);
+	}
+	printf(" par=%d\n", !!(p[3] & 0x10));
+}
+
+/* control lines as in code/pci/pins.h, all active low */
+#define CTL_FRAME  (1 << 0)
+#define CTL_IRDY   (1 << 1)
+#define CTL_TRDY   (1 << 4)
+#define CTL_DEVSEL (1 << 5)
+#define CTL_STOP   (1 << 6)
+#define CTL_BUSY   (CTL_FRAME | CTL_IRDY | CTL_TRDY | CTL_DEVSEL)
+
+#define WAVE_START 0x01
+
+/* nominal 33 MHz, the real clock is a lot slower, but GTKWave does not
+ * care and the numbers are easier to read in clocks anyway
+ */
+#define CLK_PERIOD 30
+
+static FILE *vcd;
+static uint64_t vcd_time;
+static int vcd_valid;
+static uint8_t vcd_ctl, vcd_cbe_par;
+static uint32_t vcd_ad;
+
+static const struct {
+	uint8_t mask;
+	char id;
+	const char *name;
+} vcd_lines[] = {
+	{ CTL_FRAME,  '"', "FRAME_n" },
+	{ CTL_IRDY,   '#', "IRDY_n" },
+	{ CTL_TRDY,   '$', "TRDY_n" },
+	{ CTL_DEVSEL, '%', "DEVSEL_n" },
+	{ CTL_STOP,   '&', "STOP_n" },
+};
+
+static void vcd_header() {
+	fprintf(vcd, "$timescale 1ns $end\n$scope module pci $end\n");
+	fprintf(vcd, "$var wire 1 ! CLK $end\n");
+	for (int i = 0; i < 5; i++) {
+		fprintf(vcd, "$var wire 1 %c %s $end\n", vcd_lines[i].id, vcd_lines[i].name);
+	}
+	fprintf(vcd, "$var wire 1 ' PAR $end\n");
+	fprintf(vcd, "$var wire 4 ( CBE_n [3:0] $end\n");
+	fprintf(vcd, "$var wire 32 ) AD [31:0] $end\n");
+	fprintf(vcd, "$upscope $end\n$enddefinitions $end\n");
+}
+
+static void vcd_bits(uint32_t v, int n, char id) {
+	fputc('b', vcd);
+	for (int i = n - 1; i >= 0; i--) {
+		fputc(v & (1UL << i) ? '1' : '0', vcd);
+	}
+	fprintf(vcd, " %c\n", id);
+}
+
+/* the sample is what the bus looks like at the rising edge, so it is put
+ * on the falling edge before it and only changes are written
+ */
+static void vcd_sample(uint8_t flags, uint8_t ctl, uint8_t cbe_par, uint32_t ad) {
+	if (flags & WAVE_START && vcd_valid) {
+		/* the clock ran on unsampled in between, mark the gap */
+		vcd_time += 4 * CLK_PERIOD;
+		fprintf(vcd, "#%llu\nbx )\n", (unsigned long long)vcd_time);
+		vcd_ad = ~ad;
+	}
+
+	fprintf(vcd, "#%llu\n0!\n", (unsigned long long)vcd_time);
+	for (int i = 0; i < 5; i++) {
+		uint8_t m = vcd_lines[i].mask;
+		if (!vcd_valid || ((ctl ^ vcd_ctl) & m)) {
+			fprintf(vcd, "%d%c\n", !!(ctl & m), vcd_lines[i].id);
+		}
+	}
+	if (!vcd_valid || ((cbe_par ^ vcd_cbe_par) & 0x10)) {
+		fprintf(vcd, "%d'\n", !!(cbe_par & 0x10));
+	}
+	if (!vcd_valid || ((cbe_par ^ vcd_cbe_par) & 0x0f)) {
+		vcd_bits(cbe_par & 0xf, 4, '(');
+	}
+	if (!vcd_valid || ad != vcd_ad) {
+		vcd_bits(ad, 32, ')');
+	}
+	fprintf(vcd, "#%llu\n1!\n", (unsigned long long)(vcd_time + CLK_PERIOD / 2));
+
+	vcd_time += CLK_PERIOD;
+	vcd_valid = 1;
+	vcd_ctl = ctl;
+	vcd_cbe_par = cbe_par;
+	vcd_ad = ad;
+}
+
+/* a transaction starts with FRAME# asserted on an idle bus and lasts until
+ * the clock before FRAME#, IRDY#, TRDY# and DEVSEL# are all deasserted
+ * again, i.e. without the idle turnaround clock
+ */
+static int wave_busy;
+static unsigned wave_clocks;
+static uint8_t wave_cmd;
+static uint32_t wave_addr;
+
+static unsigned long cmd_count[16], cmd_clocks[16];
+
+static void wave_end() {
+	const char *cmd = cmd_names[wave_cmd];
+	printf("T %-13s %08x %u clocks\n", cmd ? cmd : "?", wave_addr, wave_clocks);
+	cmd_count[wave_cmd]++;
+	cmd_clocks[wave_cmd] += wave_clocks;
+	wave_busy = 0;
+}
+
+static void print_wave(const uint8_t *p, uint8_t len) {
+	if (len < 7) {
+		printf("short wave frame\n");
+		return;
+	}
+	uint8_t flags = p[0], ctl = p[1], cbe_par = p[2];
+	uint32_t ad = le32(p + 3);
+
+	if (vcd) {
+		vcd_sample(flags, ctl, cbe_par, ad);
+	}
+
+	if (flags & WAVE_START && wave_busy) {
+		printf("T incomplete\n");
+		wave_busy = 0;
+	}
+	if (!wave_busy) {
+		if (!(ctl & CTL_FRAME)) {
+			wave_busy = 1;
+			wave_clocks = 1;
+			wave_cmd = cbe_par & 0xf;
+			wave_addr = ad;
+		}
+	} else if ((ctl & CTL_BUSY) == CTL_BUSY) {
+		wave_end();
+	} else {
+		wave_clocks++;
+	}
+}
+
+static void print_summary() {
+	for (int i = 0; i < 16; i++) {
+		if (!cmd_count[i]) {
+			continue;
+		}
+		const char *cmd = cmd_names[i];
+		printf("%-13s %6lu transactions, %.1f clocks each\n", cmd ? cmd : "?",
+			cmd_count[i], (double)cmd_clocks[i] / cmd_count[i]);
+	}
+}
+
+static void print_flight(const uint8_t *p, uint8_t len) {
+	static const char *status[] = { "ok", "master abort", "target abort", "retry", "parity" };
+	if (len < 14) {
+		printf("short flight recorder frame\n");
+		return;
+	}
+	const char *cmd = cmd_names[p[12] >> 4];
+	printf("F %10u %-13s %08x be=%x %08x %s\n", le32(p), cmd ? cmd : "?",
+		le32(p + 4), p[12] & 0xf, le32(p + 8), p[13] < 5 ? status[p[13]] : "?");
+}
+
+/* same as _crc_ccitt_update() from avr-libc */
+static uint16_t crc_ccitt(uint16_t crc, uint8_t data) {
+	crc ^= data;
+	for (int i = 0; i < 8; i++) {
+		crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	}
+	return crc;
+}
+
+static FILE *rom;
+static uint32_t rom_len;
+static uint16_t rom_crc = 0xffff;
+
+static void print_rom(const uint8_t *p, uint8_t len) {
+	if (len < 4) {
+		printf("short ROM frame\n");
+		return;
+	}
+	uint32_t off = le32(p);
+	if (off != rom_len) {
+		printf("ROM gap at %08x (have %08x)\n", off, rom_len);
+	}
+	for (int i = 4; i < len; i++) {
+		rom_crc = crc_ccitt(rom_crc, p[i]);
+	}
+	if (rom) {
+		fseek(rom, off, SEEK_SET);
+		fwrite(p + 4, 1, len - 4, rom);
+	}
+	rom_len = off + len - 4;
+}
+
+static void print_rom_end(const uint8_t *p, uint8_t len) {
+	if (len < 6) {
+		printf("short ROM end frame\n");
+		return;
+	}
+	uint16_t crc = p[4] | (p[5] << 8);
+	printf("ROM %u bytes, CRC %04x %s\n", le32(p), crc, crc == rom_crc ? "ok" : "BAD");
+	if (rom) {
+		fflush(rom);
+	}
+	rom_len = 0;
+	rom_crc = 0xffff;
+}
+
+static void print_frame(uint8_t id, const uint8_t *p, uint8_t len) {
+	switch (id) {
+	case TRACE_MASTER_READ:  print_transaction("R", p, len); break;
+	case TRACE_MASTER_WRITE: print_transaction("W", p, len); break;
+	case TRACE_MONITOR:      print_monitor(p, len); break;
+	case TRACE_WAVE:         print_wave(p, len); break;
+	case TRACE_ROM:          print_rom(p, len); break;
+	case TRACE_ROM_END:      print_rom_end(p, len); break;
+	case TRACE_FLIGHT:       print_flight(p, len); break;
+	default:
+		printf("event %02x:", id);
+		for (uint8_t i = 0; i < len; i++) {
+			printf(" %02x", p[i]);
+		}
+		printf("\n");
+		break;
+	}
+}
+
+int main(int argc, char **argv) {
+	int c;
+	uint8_t buf[256];
+
+	for (int i = 1; i < argc; i += 2) {
+		FILE **f;
+		if (!strcmp(argv[i], "-w")) {
+			f = &vcd;
+		} else if (!strcmp(argv[i], "-r")) {
+			f = &rom;
+		} else {
+			f = 0;
+		}
+		if (!f || i + 1 == argc) {
+			fprintf(stderr, "usage: %s [-w file.vcd] [-r rom.bin]\n", argv[0]);
+			return 1;
+		}
+		if (!(*f = fopen(argv[i + 1], "w"))) {
+			perror(argv[i + 1]);
+			return 1;
+		}
+	}
+	if (vcd) {
+		vcd_header();
+	}
+
+	while ((c = getchar()) != EOF) {
+		if (c != TRACE_SYNC) {
+			putchar(c);
+			continue;
+		}
+
+		int id = getchar();
+		int len = getchar();
+		if (id == EOF || len == EOF) {
+			break;
+		}
+		uint8_t sum = id + len;
+		for (int i = 0; i < len; i++) {
+			if ((c = getchar()) == EOF) {
+				goto out;
+			}
+			buf[i] = c;
+			sum += c;
+		}
+		if ((c = getchar()) == EOF) {
+			break;
+		}
+
+		if (sum != c) {
+			printf("\n[bad checksum, event %02x]\n", id);
+			continue;
+		}
+		if (id != TRACE_WAVE && id != TRACE_ROM) {
+			printf("\n");
+		}
+		print_frame(id, buf, len);
+		fflush(stdout);
+	}
+
+out:
+	print_summary();
+	if (vcd) {
+		fclose(vcd);
+	}
+	if (rom) {
+		fclose(rom);
+	}
+	return 0;
+}